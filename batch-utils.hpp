@@ -0,0 +1,125 @@
+// batch-utils.hpp
+// trshpnd 2024
+//
+// Modo batch: lê as pesquisas de um arquivo (ou de um pipe em stdin), executa-as em
+// paralelo sobre a Database, que só é lida, e escreve os resultados na ordem da entrada.
+// As pesquisas são processadas em janelas de BATCH_WINDOW linhas; as threads pegam a
+// próxima linha da janela por um contador atômico e guardam o resultado no slot da linha.
+// Um comando 'rate' fecha a janela: roda sozinho depois das pesquisas anteriores, então
+// as seguintes já vêem a avaliação.
+// Ao fim, imprime o throughput e as latências p50/p99 de cada tipo de pesquisa.
+
+#pragma once
+
+#include "query-utils.hpp"
+#include "update-utils.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+#define BATCH_WINDOW 4096
+
+struct BatchReport{
+    size_t queries = 0;
+    double seconds = 0;
+    vector<double> latencies[QUERY_TYPES];     // Em microssegundos.
+};
+
+// Percentil 'p' (0 a 1) de um vetor já ordenado.
+double percentile(const vector<double> &sorted, double p){
+    if(sorted.empty()) return 0;
+    size_t i = min(sorted.size() - 1, (size_t) (p * sorted.size()));
+    return sorted[i];
+}
+
+void printBatchReport(BatchReport &report, ostream &out){
+    out << "Batch: " << report.queries << " pesquisas em " << fixed << setprecision(3) << report.seconds << " s ("
+        << setprecision(0) << (report.seconds > 0 ? report.queries / report.seconds : 0) << " pesquisas/s)" << endl;
+
+    for(int type = 0; type < QUERY_TYPES; type++){
+        vector<double> &lat = report.latencies[type];
+        if(lat.empty()) continue;
+        sort(lat.begin(), lat.end());
+        out << "  " << setw(12) << left << QUERY_NAMES[type] << right
+            << setw(8) << lat.size() << "  p50 " << setw(9) << setprecision(1) << percentile(lat, 0.50)
+            << " us  p99 " << setw(9) << percentile(lat, 0.99) << " us" << endl;
+    }
+}
+
+// Executa as pesquisas de 'in' com nThreads threads. 'sair' encerra a leitura. 'format' é o
+// formato de saída das pesquisas que não indicam outro.
+BatchReport runBatch(Database &db, istream &in, int nThreads, ostream &out, OutputFormat format = FORMAT_TABLE){
+    BatchReport report;
+    vector<string> lines, results(BATCH_WINDOW);
+    vector<double> latency(BATCH_WINDOW);
+    vector<QueryType> types(BATCH_WINDOW);
+    vector<QueryScratch> scratch(nThreads);
+    for(auto &s : scratch) s.format = format;
+    string line;
+    bool quit = false, more = true;
+
+    auto start = chrono::steady_clock::now();
+
+    while(!quit && more){
+        lines.clear();
+        bool update = false;
+        while(lines.size() < BATCH_WINDOW && !update && (more = (bool) getline(in, line))){
+            if(line.find_first_not_of(" \t\r") == string::npos) continue;
+            lines.push_back(line);
+            update = isUpdateCommand(line);
+        }
+        if(lines.empty()) break;
+
+        // Pesquisas da janela em paralelo; a atualização, se houver, é a última linha.
+        size_t queries = lines.size() - (update ? 1 : 0);
+        atomic<size_t> next(0);
+        auto worker = [&](int t){
+            ostringstream buffer;
+            for(size_t i = next++; i < queries; i = next++){
+                buffer.str("");
+                auto begin = chrono::steady_clock::now();
+                types[i] = runCommand(db, lines[i], scratch[t], buffer);
+                latency[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count();
+                results[i] = buffer.str();
+            }
+        };
+
+        if(nThreads == 1) worker(0);
+        else{
+            vector<thread> workers;
+            for(int t = 0; t < nThreads; t++) workers.emplace_back(worker, t);
+            for(auto &w : workers) w.join();
+        }
+
+        if(update){
+            ostringstream buffer;
+            auto begin = chrono::steady_clock::now();
+            types[queries] = runCommand(db, lines[queries], scratch[0], buffer);
+            latency[queries] = chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count();
+            results[queries] = buffer.str();
+        }
+
+        for(size_t i = 0; i < lines.size(); i++){
+            if(types[i] == QUERY_QUIT){
+                quit = true;
+                break;
+            }
+            out << results[i];
+            report.latencies[types[i]].push_back(latency[i]);
+            report.queries++;
+        }
+    }
+    out.flush();
+
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return report;
+}
@@ -0,0 +1,464 @@
+// Benchmark
+//
+// Gera um dataset sintético (players.csv, rating.csv, tags.csv) na escala pedida, com
+// popularidade de jogadores e atividade de usuários seguindo uma distribuição de Zipf,
+// mede cada etapa da construção e cada tipo de pesquisa separadamente e grava os
+// resultados em JSON. Com --write-golden / --golden, o hash da saída de cada pesquisa é
+// gravado / comparado, para garantir que mudanças de desempenho não mudem os resultados.
+//
+// Build: g++ -std=c++17 -O2 -pthread bench.cpp -o bench
+// Uso:   ./bench --generate <dir> [--ratings 1000000] [--players 19000] [--users n] [--tags n]
+//                [--skew 1.0] [--seed 42] [--generate-only]
+//        ./bench --data <dir> [--threads n] [--queries 1000] [--json arquivo]
+//                [--write-golden arquivo] [--golden arquivo] [--check-external MB]
+// Golden: mkdir -p /tmp/golden-data && ./bench --generate /tmp/golden-data --seed 42
+//                --players 2000 --ratings 200000 --queries 20 --golden golden/bench-small.txt
+//
+//      trshpnd 2024
+
+#include "csv-utils.hpp"
+#include "hash-utils.hpp"
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "position-utils.hpp"
+#include "tag-utils.hpp"
+#include "query-utils.hpp"
+#include "load-utils.hpp"
+#include "batch-utils.hpp"
+
+#include <stdlib.h>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <map>
+#include <thread>
+
+using namespace std;
+
+#define BENCH_BUFFER (1 << 20)
+
+const char* SYLLABLES[] = {
+    "ma", "ro", "li", "an", "to", "se", "ri", "ka", "lo", "ne", "da", "vi", "mo", "ha", "ze",
+    "be", "na", "lu", "ta", "gi", "el", "or", "us", "in", "ar", "do", "fe", "ju", "pa", "co"
+};
+const char* NATIONS[] = {
+    "Brazil", "Argentina", "Spain", "France", "Germany", "England", "Italy", "Portugal", "Netherlands",
+    "Belgium", "Uruguay", "Colombia", "Croatia", "Poland", "Japan", "Mexico", "United States", "Nigeria"
+};
+const char* LEAGUES[] = {
+    "Spain Primera Division", "English Premier League", "Italian Serie A", "German 1. Bundesliga",
+    "French Ligue 1", "Portuguese Liga ZON SAGRES", "Holland Eredivisie", "Campeonato Brasileiro Serie A",
+    "Argentina Primera Division", "USA Major League Soccer", "Japanese J. League Division 1"
+};
+const char* TAG_NAMES[] = {
+    "Engine", "Distance Shooter", "FK Specialist", "Playmaker", "Aerial Threat", "Poacher", "Complete Forward",
+    "Crosser", "Strength", "Acrobat", "Clinical Finisher", "Speedster", "Tactician", "Tackling", "Dribbler"
+};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof(a[0]))
+#define CLUBS_PER_LEAGUE 18
+
+// Amostragem de Zipf por tabela acumulada: o item de posição k (0 = mais popular) tem
+// peso 1 / (k + 1)^s.
+struct ZipfSampler{
+    vector<double> cdf;
+
+    ZipfSampler(size_t n, double s){
+        cdf.resize(n);
+        double sum = 0;
+        for(size_t k = 0; k < n; k++){
+            sum += 1.0 / pow(k + 1.0, s);
+            cdf[k] = sum;
+        }
+        for(auto &c : cdf) c /= sum;
+    }
+
+    size_t operator()(mt19937_64 &rng) const{
+        double u = uniform_real_distribution<double>(0, 1)(rng);
+        size_t k = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        return min(k, cdf.size() - 1);
+    }
+};
+
+// Saída bufferizada para os CSVs grandes.
+struct CsvWriter{
+    FILE* file;
+    string buffer;
+
+    CsvWriter(const string &path) : file(fopen(path.c_str(), "wb")) {}
+    ~CsvWriter(){ flush(); if(file) fclose(file); }
+
+    void flush(){
+        if(file) fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+    void write(string_view text){
+        buffer += text;
+        if(buffer.size() >= BENCH_BUFFER) flush();
+    }
+};
+
+struct GeneratorOptions{
+    size_t players = 19000;
+    size_t ratings = 1000000;
+    size_t users = 0;       // 0: ratings / 150
+    size_t tags = 0;        // 0: ratings / 60
+    double skew = 1.0;
+    uint64_t seed = 42;
+};
+
+string capitalized(string word){
+    if(!word.empty()) word[0] = toupper(word[0]);
+    return word;
+}
+
+string syllableWord(mt19937_64 &rng){
+    string word;
+    int n = 2 + rng() % 2;
+    for(int i = 0; i < n; i++) word += SYLLABLES[rng() % COUNT_OF(SYLLABLES)];
+    return capitalized(word);
+}
+
+// Gera os três CSVs em 'dir'. Retorna false se algum arquivo não puder ser criado.
+bool generateDataset(const string &dir, GeneratorOptions options){
+    mt19937_64 rng(options.seed);
+    if(options.users == 0) options.users = max<size_t>(1, options.ratings / 150);
+    if(options.tags == 0) options.tags = max<size_t>(1, options.ratings / 60);
+
+    // Jogadores: ids crescentes com saltos aleatórios, nota "real" usada nas avaliações.
+    vector<int> playerIds(options.players);
+    vector<double> quality(options.players);
+    int nextId = 1;
+    for(size_t i = 0; i < options.players; i++){
+        nextId += 1 + rng() % 13;
+        playerIds[i] = nextId;
+        quality[i] = uniform_real_distribution<double>(1.5, 4.5)(rng);
+    }
+
+    CsvWriter players(dir + "/players.csv");
+    if(!players.file) return false;
+    players.write("sofifa_id,short_name,long_name,player_positions,nationality,club_name,league_name\n");
+    for(size_t i = 0; i < options.players; i++){
+        string first = syllableWord(rng), last = syllableWord(rng), middle = (rng() % 3 == 0) ? syllableWord(rng) + " " : "";
+
+        string positions;
+        int nPositions = 1 + rng() % 3;
+        uint16_t used = 0;
+        for(int p = 0; p < nPositions; p++){
+            int code = rng() % POSITION_COUNT;
+            if(used & (1u << code)) continue;
+            used |= 1u << code;
+            positions += (positions.empty() ? "" : ", ") + string(POSITION_NAMES[code]);
+        }
+
+        size_t league = rng() % COUNT_OF(LEAGUES);
+        string club = syllableWord(rng).substr(0, 1) + ". " + LEAGUES[league] + " " + to_string(rng() % CLUBS_PER_LEAGUE + 1);
+
+        players.write(to_string(playerIds[i]) + "," + first.substr(0, 1) + ". " + last + "," + first + " " + middle + last + ",\""
+                      + positions + "\"," + NATIONS[rng() % COUNT_OF(NATIONS)] + "," + club + "," + LEAGUES[league] + "\n");
+    }
+
+    // Popularidade: a posição no Zipf é mapeada para um jogador/usuário aleatório.
+    vector<size_t> playerRank(options.players), userRank(options.users);
+    for(size_t i = 0; i < playerRank.size(); i++) playerRank[i] = i;
+    for(size_t i = 0; i < userRank.size(); i++) userRank[i] = i + 1;
+    shuffle(playerRank.begin(), playerRank.end(), rng);
+    shuffle(userRank.begin(), userRank.end(), rng);
+
+    ZipfSampler playerZipf(options.players, options.skew);
+    ZipfSampler userZipf(options.users, options.skew * 0.8);
+    normal_distribution<double> noise(0, 1);
+
+    CsvWriter ratings(dir + "/rating.csv");
+    if(!ratings.file) return false;
+    ratings.write("user_id,sofifa_id,rating\n");
+    char line[64];
+    for(size_t i = 0; i < options.ratings; i++){
+        size_t p = playerRank[playerZipf(rng)];
+        double value = round((quality[p] + noise(rng)) * 2) / 2;
+        value = min(5.0, max(0.5, value));
+        snprintf(line, sizeof(line), "%zu,%d,%.1f\n", userRank[userZipf(rng)], playerIds[p], value);
+        ratings.write(line);
+    }
+
+    ZipfSampler tagZipf(COUNT_OF(TAG_NAMES), 0.3);
+    CsvWriter tags(dir + "/tags.csv");
+    if(!tags.file) return false;
+    tags.write("user_id,sofifa_id,tag\n");
+    for(size_t i = 0; i < options.tags; i++){
+        snprintf(line, sizeof(line), "%zu,%d,", userRank[userZipf(rng)], playerIds[playerRank[playerZipf(rng)]]);
+        tags.write(string(line) + TAG_NAMES[tagZipf(rng)] + "\n");
+    }
+    return true;
+}
+
+// Pesquisas sintéticas tiradas dos dados carregados, na proporção 1:1:1:1:1:1, mais um 'top'
+// com filtros (liga, clube ou nacionalidade de um jogador sorteado) por 'top' simples.
+vector<string> generateWorkload(const Database &db, size_t perType, uint64_t seed){
+    mt19937_64 rng(seed);
+    vector<string> lines;
+
+    vector<int> userIds;
+    hashForEach(db.users, [&](const User &user){ userIds.push_back(user.id); });
+    sort(userIds.begin(), userIds.end());
+
+    vector<string> tagNames;
+    db.tagIndex.tagDictionary().forEachWord([&](const string &tag, const vector<int> &){ tagNames.push_back(tag); });
+
+    for(size_t i = 0; i < perType && db.players.size() > 0; i++){
+        string name = toLowerCase(db.players.text(rng() % db.players.size(), LONG_NAME));
+        string prefix = name.substr(0, 1 + rng() % 4);
+        lines.push_back("player " + prefix + ((rng() % 2) ? " " + to_string(1 + rng() % 20) : ""));
+    }
+    for(size_t i = 0; i < perType && !userIds.empty(); i++){
+        lines.push_back("user " + to_string(userIds[rng() % userIds.size()]));
+    }
+    for(size_t i = 0; i < perType; i++){
+        lines.push_back("top " + to_string(1 + rng() % 50) + " " + POSITION_NAMES[rng() % POSITION_COUNT]);
+    }
+    for(size_t i = 0; i < perType && !tagNames.empty(); i++){
+        string line = "tags";
+        int n = 1 + rng() % 3;
+        for(int t = 0; t < n; t++) line += " '" + tagNames[rng() % tagNames.size()] + "'";
+        lines.push_back(line);
+    }
+
+    for(size_t i = 0; i < perType && db.players.size() > 0; i++){
+        string name = toLowerCase(db.players.text(rng() % db.players.size(), (rng() % 2) ? LONG_NAME : SHORT_NAME));
+        size_t length = min(name.size(), (size_t) (2 + rng() % 5));
+        lines.push_back("contains " + name.substr(rng() % (name.size() - length + 1), length));
+    }
+
+    const char* filterNames[PLAYER_CATEGORY_FIELDS] = {"nation", "club", "league"};
+    for(size_t i = 0; i < perType && db.players.size() > 0; i++){
+        int c = rng() % PLAYER_CATEGORY_FIELDS;
+        string value(db.players.text(rng() % db.players.size(), (PlayerField) (PLAYER_FREE_FIELDS + c)));
+        string line = "top " + to_string(1 + rng() % 50);
+        if(rng() % 2) line += string(" ") + POSITION_NAMES[rng() % POSITION_COUNT];
+        lines.push_back(line + " " + filterNames[c] + " '" + value + "'");
+    }
+
+    for(size_t i = 0; i < perType && db.players.size() > 0; i++){
+        lines.push_back("similar " + to_string(db.players.id(rng() % db.players.size())) + " " + to_string(1 + rng() % 20) + ((rng() % 2) ? " corr" : ""));
+    }
+
+    shuffle(lines.begin(), lines.end(), rng);
+    return lines;
+}
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+
+uint64_t fnv1a(const string &text, uint64_t hash = FNV_OFFSET){
+    for(unsigned char c : text){
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Refaz a carga das avaliações em memória externa (limitada a 'memoryBytes', arquivos em
+// 'dataDir') e compara com a carga em memória da Database. Os índices dos usuários diferem
+// entre as duas, mas a lista de cada usuário (na ordem do arquivo) e os totais de cada
+// jogador devem ser iguais. Retorna o número de usuários e jogadores diferentes.
+size_t checkExternal(const Database &db, const string &dataDir, size_t memoryBytes){
+    PlayerStore players(db.players.size());
+    HashTable<User> users(db.users.count);
+    RatingStore ratings;
+    buildHash(players, users, ratings, dataDir + "/players.csv", dataDir + "/rating.csv", 1, nullptr, memoryBytes, dataDir);
+    remove((dataDir + "/ratings.bin").c_str());
+
+    size_t differences = users.count != db.users.count;
+    hashForEach(db.users, [&](const User &user){
+        const User* other = nullptr;
+        hashSearch(users, user.id, other);
+        RatingSpan expected = db.userRatings.ratings(user.index);
+        RatingSpan found = other ? ratings.ratings(other->index) : RatingSpan();
+        bool same = expected.size() == found.size();
+        for(size_t i = 0; same && i < expected.size(); i++){
+            same = expected[i].id == found[i].id && expected[i].rating == found[i].rating;
+        }
+        if(!same) differences++;
+    });
+    for(int index = 0; index < (int) db.players.size(); index++){
+        if(players.totalRatings(index) != db.players.totalRatings(index) || players.rating(index) != db.players.rating(index)) differences++;
+    }
+    return differences;
+}
+
+template <typename Function>
+double timed(Function fn){
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]){
+    GeneratorOptions options;
+    string generateDir, dataDir, jsonPath, goldenPath, writeGoldenPath;
+    size_t externalMemory = 0;
+    bool generateOnly = false;
+    int nThreads = max(1u, thread::hardware_concurrency());
+    size_t perType = 1000;
+    uint64_t querySeed = 7;
+
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--generate" && hasValue) generateDir = argv[++i];
+        else if(arg == "--generate-only") generateOnly = true;
+        else if(arg == "--data" && hasValue) dataDir = argv[++i];
+        else if(arg == "--players" && hasValue) options.players = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--ratings" && hasValue) options.ratings = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--users" && hasValue) options.users = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--tags" && hasValue) options.tags = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--skew" && hasValue) options.skew = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue) options.seed = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--threads" && hasValue) nThreads = max(1, atoi(argv[++i]));
+        else if(arg == "--queries" && hasValue) perType = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--json" && hasValue) jsonPath = argv[++i];
+        else if(arg == "--golden" && hasValue) goldenPath = argv[++i];
+        else if(arg == "--write-golden" && hasValue) writeGoldenPath = argv[++i];
+        else if(arg == "--check-external" && hasValue) externalMemory = (size_t) max(1, atoi(argv[++i])) << 20;
+        else{
+            cerr << "Opcao desconhecida: " << arg << endl;
+            return 2;
+        }
+    }
+
+    if(!generateDir.empty()){
+        cerr << "Gerando dataset em " << generateDir << "... ";
+        double seconds = timed([&]{
+            if(!generateDataset(generateDir, options)){
+                cerr << "Falha ao criar os arquivos." << endl;
+                exit(1);
+            }
+        });
+        cerr << "Pronto (" << seconds << " s)." << endl;
+        if(generateOnly) return 0;
+        if(dataDir.empty()) dataDir = generateDir;
+    }
+    if(dataDir.empty()){
+        cerr << "Informe --data <dir> ou --generate <dir>." << endl;
+        return 2;
+    }
+
+    // As mensagens de progresso da carga vão para stderr; stdout fica com o JSON.
+    streambuf* coutBuffer = cout.rdbuf(cerr.rdbuf());
+
+    Database db(options.players, options.users ? options.users : 16);
+    double stageHash = timed([&]{ buildHash(db.players, db.users, db.userRatings, dataDir + "/players.csv", dataDir + "/rating.csv", nThreads); });
+    double stagePlayerTrie = timed([&]{ buildPlayerTrie(db.players, db.playerNames); });
+    double stageTagsTrie = timed([&]{ buildTagsTrie(dataDir + "/tags.csv", db.tagIndex, nThreads); });
+    double stageNameIndex = timed([&]{ db.nameIndex.build(db.players); });
+    double stageFilterIndex = timed([&]{ db.filterIndex.build(db.players); });
+    double stageSimilar = timed([&]{ db.similar.build(db.players, db.userRatings, nThreads); });
+    double stageRankings = timed([&]{ buildRankings(db); });
+
+    size_t externalDifferences = 0;
+    if(externalMemory > 0){
+        externalDifferences = checkExternal(db, dataDir, externalMemory);
+        if(externalDifferences) cerr << "A carga em memoria externa difere da carga em memoria (" << externalDifferences << " diferencas)." << endl;
+    }
+
+    cout.rdbuf(coutBuffer);
+
+    // Pesquisas, uma de cada vez, medindo cada uma.
+    vector<string> workload = generateWorkload(db, perType, querySeed);
+    vector<uint64_t> hashes;
+    uint64_t sequentialHash = FNV_OFFSET;
+    BatchReport sequential;
+    QueryScratch scratch;
+    ostringstream buffer;
+
+    sequential.seconds = timed([&]{
+        for(const auto &line : workload){
+            buffer.str("");
+            auto begin = chrono::steady_clock::now();
+            QueryType type = runQuery(db, line, scratch, buffer);
+            sequential.latencies[type].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+            hashes.push_back(fnv1a(buffer.str()));
+            sequentialHash = fnv1a(buffer.str(), sequentialHash);
+        }
+    });
+    sequential.queries = workload.size();
+
+    // A mesma carga no modo batch, com nThreads threads.
+    string joined;
+    for(const auto &line : workload) joined += line + "\n";
+    istringstream batchInput(joined);
+    ostringstream batchOutput;
+    BatchReport parallel = runBatch(db, batchInput, nThreads, batchOutput);
+    bool batchMatches = fnv1a(batchOutput.str()) == sequentialHash;
+    if(!batchMatches) cerr << "A saida do modo batch difere da execucao sequencial." << endl;
+
+    // Golden: uma linha "hash<TAB>pesquisa" por pesquisa, na ordem da carga.
+    size_t mismatches = 0, checked = 0;
+    if(!writeGoldenPath.empty()){
+        ofstream golden(writeGoldenPath);
+        for(size_t i = 0; i < workload.size(); i++) golden << hex << hashes[i] << dec << "\t" << workload[i] << "\n";
+    }
+    if(!goldenPath.empty()){
+        ifstream golden(goldenPath);
+        string line;
+        map<string, uint64_t> expected;
+        while(getline(golden, line)){
+            size_t tab = line.find('\t');
+            if(tab == string::npos) continue;
+            expected[line.substr(tab + 1)] = strtoull(line.substr(0, tab).c_str(), nullptr, 16);
+        }
+        for(size_t i = 0; i < workload.size(); i++){
+            auto it = expected.find(workload[i]);
+            if(it == expected.end()) continue;
+            checked++;
+            if(it->second != hashes[i]){
+                mismatches++;
+                if(mismatches <= 10) cerr << "Resultado diferente: " << workload[i] << endl;
+            }
+        }
+        // Nenhuma pesquisa em comum: dataset ou --queries diferentes dos usados na gravação.
+        if(checked == 0){
+            cerr << "Nenhuma pesquisa do golden foi executada (confira o dataset e --queries)." << endl;
+            mismatches = 1;
+        }
+    }
+
+    // Relatório JSON.
+    ostringstream json;
+    json << fixed << setprecision(6);
+    json << "{\n";
+    json << "  \"dataset\": {\"dir\": \"" << dataDir << "\", \"players\": " << db.players.size() << ", \"users\": " << db.users.count
+         << ", \"ratings\": " << db.userRatings.ratingCount() << ", \"tags\": " << db.tagIndex.tagCount() << "},\n";
+    json << "  \"threads\": " << nThreads << ",\n";
+    json << "  \"stages\": {\"buildHash\": " << stageHash << ", \"buildPlayerTrie\": " << stagePlayerTrie
+         << ", \"buildTagsTrie\": " << stageTagsTrie << ", \"buildNameIndex\": " << stageNameIndex << ", \"buildFilterIndex\": " << stageFilterIndex << ", \"buildSimilar\": " << stageSimilar << ", \"buildRankings\": " << stageRankings << "},\n";
+    json << "  \"queries\": {";
+    bool first = true;
+    for(int type = 0; type < QUERY_TYPES; type++){
+        vector<double> &lat = sequential.latencies[type];
+        if(lat.empty()) continue;
+        double total = 0;
+        for(double l : lat) total += l;
+        sort(lat.begin(), lat.end());
+        json << (first ? "\n" : ",\n") << "    \"" << QUERY_NAMES[type] << "\": {\"count\": " << lat.size() << ", \"total_s\": " << total / 1e6
+             << ", \"p50_us\": " << percentile(lat, 0.50) << ", \"p99_us\": " << percentile(lat, 0.99) << "}";
+        first = false;
+    }
+    json << "\n  },\n";
+    json << "  \"batch\": {\"queries\": " << parallel.queries << ", \"seconds\": " << parallel.seconds
+         << ", \"queries_per_s\": " << (parallel.seconds > 0 ? parallel.queries / parallel.seconds : 0)
+         << ", \"matches_sequential\": " << (batchMatches ? "true" : "false") << "},\n";
+    json << "  \"golden\": {\"checked\": " << checked << ", \"mismatches\": " << mismatches << "}";
+    if(externalMemory > 0) json << ",\n  \"external\": {\"memory_mb\": " << (externalMemory >> 20) << ", \"differences\": " << externalDifferences << "}";
+    json << "\n";
+    json << "}\n";
+
+    if(jsonPath.empty()) cout << json.str();
+    else ofstream(jsonPath) << json.str();
+
+    return (mismatches || !batchMatches || externalDifferences) ? 1 : 0;
+}
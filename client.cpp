@@ -0,0 +1,131 @@
+// Cliente do modo servidor
+//
+// Sem --load, envia cada linha de stdin ao servidor e imprime as respostas (mesma saída
+// do menu). Com --load, gera carga: --clients conexões simultâneas percorrem o arquivo de
+// pesquisas em ciclo (cada uma começando em um ponto diferente) durante --seconds
+// segundos, ou uma vez se --seconds for 0, e ao fim imprime o throughput e as latências
+// p50/p99 de cada tipo de pesquisa.
+//
+// Build: g++ -std=c++17 -O2 -pthread client.cpp -o client
+// Uso:   ./client <socket|localhost:porta>
+//        ./client <socket|localhost:porta> --load <arquivo> [--clients 8] [--seconds 10]
+//
+//      trshpnd 2024
+
+#include "query-utils.hpp"
+#include "batch-utils.hpp"
+#include "server-utils.hpp"
+
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        cerr << "Uso: " << argv[0] << " <socket|localhost:porta> [--load arquivo] [--clients n] [--seconds s]" << endl;
+        return 2;
+    }
+    string address = argv[1], loadPath;
+    int clients = 8;
+    double seconds = 10;
+
+    for(int i = 2; i < argc; i++){
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--load" && hasValue) loadPath = argv[++i];
+        else if(arg == "--clients" && hasValue) clients = max(1, atoi(argv[++i]));
+        else if(arg == "--seconds" && hasValue) seconds = atof(argv[++i]);
+        else{
+            cerr << "Opcao desconhecida: " << arg << endl;
+            return 2;
+        }
+    }
+
+    // Modo interativo / pipe.
+    if(loadPath.empty()){
+        int fd = openSocket(address, false);
+        if(fd < 0){
+            cerr << "Servidor " << address << " indisponivel." << endl;
+            return 1;
+        }
+        SocketReader reader(fd);
+        string line, response;
+        while(getline(cin, line)){
+            line += '\n';
+            if(!sendAll(fd, line.data(), line.size()) || !reader.readResponse(response)) break;
+            cout << response << flush;
+            if(queryType(line) == QUERY_QUIT) break;
+        }
+        close(fd);
+        return 0;
+    }
+
+    // Gerador de carga.
+    vector<string> queries;
+    {
+        ifstream in(loadPath);
+        string line;
+        while(getline(in, line)){
+            if(line.find_first_not_of(" \t\r") != string::npos && queryType(line) != QUERY_QUIT) queries.push_back(line + "\n");
+        }
+    }
+    if(queries.empty()){
+        cerr << "Arquivo de pesquisas " << loadPath << " vazio ou inexistente." << endl;
+        return 1;
+    }
+
+    vector<BatchReport> reports(clients);
+    vector<thread> workers;
+    atomic<int> failures(0);
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+
+    for(int c = 0; c < clients; c++){
+        workers.emplace_back([&, c]{
+            int fd = openSocket(address, false);
+            if(fd < 0){
+                failures++;
+                return;
+            }
+            SocketReader reader(fd);
+            string response;
+            BatchReport &report = reports[c];
+
+            size_t first = queries.size() * c / clients;
+            for(size_t n = 0; seconds > 0 ? chrono::steady_clock::now() < deadline : n < queries.size(); n++){
+                const string &query = queries[(first + n) % queries.size()];
+                auto begin = chrono::steady_clock::now();
+                if(!sendAll(fd, query.data(), query.size()) || !reader.readResponse(response)){
+                    failures++;
+                    break;
+                }
+                report.latencies[queryType(query)].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+                report.queries++;
+            }
+            close(fd);
+        });
+    }
+    for(auto &worker : workers) worker.join();
+
+    BatchReport total;
+    total.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for(auto &report : reports){
+        total.queries += report.queries;
+        for(int type = 0; type < QUERY_TYPES; type++){
+            total.latencies[type].insert(total.latencies[type].end(), report.latencies[type].begin(), report.latencies[type].end());
+        }
+    }
+
+    cout << clients << " cliente(s)";
+    if(failures) cout << ", " << failures << " falha(s) de conexao";
+    cout << endl;
+    printBatchReport(total, cout);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+// csv-utils.hpp
+// trshpnd 2024
+//
+// Leitor de CSV sem cópias. O arquivo é mapeado em memória (mmap) e os campos são
+// devolvidos como string_view apontando para o próprio mapeamento. Inteiros e floats
+// são convertidos no lugar com from_chars.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define CSV_HAS_MMAP
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Arquivo somente leitura mapeado em memória. Em plataformas sem mmap o conteúdo
+// é lido inteiro para um buffer.
+class MappedFile {
+private:
+    const char* fileData = nullptr;
+    size_t fileSize = 0;
+    bool mapped = false;
+    string buffer;
+
+public:
+    explicit MappedFile(const string& path) {
+#ifdef CSV_HAS_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                fileData = (const char*) addr;
+                fileSize = st.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+        if (mapped) return;
+#endif
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return;
+        buffer.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+        fileData = buffer.data();
+        fileSize = buffer.size();
+    }
+
+    ~MappedFile() {
+#ifdef CSV_HAS_MMAP
+        if (mapped) munmap((void*) fileData, fileSize);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return fileData != nullptr; }
+    const char* data() const { return fileData; }
+    size_t size() const { return fileSize; }
+};
+
+// Retorna o primeiro ',' ou '\n' em [p, end), ou end. Compara 16 bytes por vez com SSE2.
+inline const char* findDelimiter(const char* p, const char* end, char delim = ',') {
+#ifdef __SSE2__
+    const __m128i vDelim = _mm_set1_epi8(delim);
+    const __m128i vNewline = _mm_set1_epi8('\n');
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, vDelim), _mm_cmpeq_epi8(chunk, vNewline)));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != delim && *p != '\n') p++;
+    return p;
+}
+
+// Leitura campo a campo de um intervalo [begin, end) de um CSV. Campos entre aspas
+// (ex.: "RW, ST, CF") são suportados, inclusive aspas escapadas ("").
+class CsvReader {
+private:
+    const char* pos;
+    const char* end;
+    char delim;
+    bool rowOpen;
+    string scratch; // Usado apenas por campos com aspas escapadas.
+
+    // Campo entre aspas. 'pos' aponta para a aspa de abertura.
+    void quotedField(string_view& field) {
+        const char* start = ++pos;
+        bool escaped = false;
+        scratch.clear();
+
+        while (true) {
+            const char* quote = (const char*) memchr(pos, '"', end - pos);
+            if (quote == nullptr) {                     // Aspas não fechadas: vai até o fim.
+                if (escaped) scratch.append(pos, end);
+                field = escaped ? string_view(scratch) : string_view(start, end - start);
+                pos = end;
+                rowOpen = false;
+                return;
+            }
+            if (quote + 1 < end && quote[1] == '"') {   // Aspa escapada.
+                scratch.append(pos, quote + 1);
+                escaped = true;
+                pos = quote + 2;
+                continue;
+            }
+            if (escaped) scratch.append(pos, quote);
+            field = escaped ? string_view(scratch) : string_view(start, quote - start);
+            pos = quote + 1;
+            break;
+        }
+
+        // Descarta o que houver entre a aspa de fechamento e o delimitador.
+        const char* stop = findDelimiter(pos, end, delim);
+        rowOpen = (stop < end && *stop == delim);
+        pos = stop < end ? stop + 1 : end;
+    }
+
+public:
+    CsvReader(const char* begin, const char* end, char delim = ',')
+        : pos(begin), end(end), delim(delim), rowOpen(begin < end) {}
+
+    explicit CsvReader(const MappedFile& file, char delim = ',')
+        : CsvReader(file.data(), file.data() + file.size(), delim) {}
+
+    // Lê o próximo campo da linha atual. Retorna false quando a linha acabou.
+    // O string_view é válido até a próxima chamada.
+    bool nextField(string_view& field) {
+        if (!rowOpen) return false;
+
+        if (pos < end && *pos == '"') {
+            quotedField(field);
+        } else {
+            const char* stop = findDelimiter(pos, end, delim);
+            const char* fieldEnd = stop;
+            if (fieldEnd > pos && fieldEnd[-1] == '\r' && (stop == end || *stop == '\n')) fieldEnd--;
+
+            field = string_view(pos, fieldEnd - pos);
+            rowOpen = (stop < end && *stop == delim);
+            pos = stop < end ? stop + 1 : end;
+        }
+
+        return true;
+    }
+
+    // Descarta o restante da linha atual e posiciona a leitura na próxima.
+    void nextRow() {
+        string_view field;
+        while (nextField(field)) {}
+        rowOpen = pos < end;
+    }
+
+    bool atEnd() const { return !rowOpen && pos >= end; }
+
+    // Posição de leitura no arquivo.
+    const char* position() const { return pos; }
+};
+
+// Conversões no lugar, sem alocação. Retornam false se o campo não for numérico.
+inline bool parseInt(string_view field, int& value) {
+    auto result = from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == errc();
+}
+
+inline bool parseFloat(string_view field, float& value) {
+    auto result = from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == errc();
+}
+
+// Divide o arquivo em 'nChunks' intervalos de bytes alinhados ao início de linhas.
+// O cabeçalho fica de fora do primeiro chunk. Retorna nChunks + 1 fronteiras.
+// Pressupõe que nenhum campo entre aspas contenha quebras de linha.
+vector<size_t> splitIntoChunks(const MappedFile& file, int nChunks) {
+    const char* data = file.data();
+    size_t size = file.size();
+
+    auto nextLine = [&](size_t from) -> size_t {
+        if (from >= size) return size;
+        const char* nl = (const char*) memchr(data + from, '\n', size - from);
+        return nl ? (nl - data) + 1 : size;
+    };
+
+    size_t first = nextLine(0);
+    vector<size_t> bounds;
+    bounds.push_back(first);
+
+    for (int i = 1; i < nChunks; i++) {
+        size_t pos = first + (size - first) * i / nChunks;
+        bounds.push_back(max(nextLine(pos - 1), bounds.back()));
+    }
+    bounds.push_back(size);
+
+    return bounds;
+}
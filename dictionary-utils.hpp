@@ -0,0 +1,79 @@
+// dictionary-utils.hpp
+// trshpnd 2024
+//
+// Dicionário de strings: cada valor distinto recebe um código denso, na ordem de inserção.
+// Os valores ficam em uma arena e a busca é uma tabela hash de endereçamento aberto
+// (sondagem linear) de códigos. Usado nas tags da carga e nas colunas categóricas dos
+// jogadores (nacionalidade, clube e liga).
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+using namespace std;
+
+#define DICTIONARY_NONE UINT32_MAX
+
+class StringDictionary {
+private:
+    string arena;
+    vector<uint32_t> offsets{0};    // Início de cada valor em 'arena' (+1 sentinela).
+    vector<uint32_t> slots;         // Código do valor, ou DICTIONARY_NONE.
+    size_t mask;
+
+    static uint64_t hashText(string_view text) {
+        uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Slot do valor, ou o slot vazio onde ele entraria.
+    size_t slotOf(string_view text) const {
+        size_t slot = hashText(text) & mask;
+        while (slots[slot] != DICTIONARY_NONE && value(slots[slot]) != text) slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    void grow() {
+        slots.assign(slots.size() * 2, DICTIONARY_NONE);
+        mask = slots.size() - 1;
+        for (uint32_t code = 0; code < size(); code++) slots[slotOf(value(code))] = code;
+    }
+
+public:
+    StringDictionary() : slots(64, DICTIONARY_NONE), mask(63) {}
+
+    uint32_t size() const { return offsets.size() - 1; }
+
+    string_view value(uint32_t code) const {
+        return string_view(arena).substr(offsets[code], offsets[code + 1] - offsets[code]);
+    }
+
+    // Código do valor, ou DICTIONARY_NONE se ele não estiver no dicionário.
+    uint32_t find(string_view text) const {
+        return slots[slotOf(text)];
+    }
+
+    // Código do valor, inserindo-o se for novo.
+    uint32_t insert(string_view text) {
+        size_t slot = slotOf(text);
+        if (slots[slot] != DICTIONARY_NONE) return slots[slot];
+
+        uint32_t code = size();
+        arena.append(text);
+        offsets.push_back(arena.size());
+        slots[slot] = code;
+        if (size() * 2 > slots.size()) grow();    // Ocupação máxima de 1/2.
+        return code;
+    }
+
+    size_t memoryBytes() const {
+        return arena.capacity() + offsets.capacity() * sizeof(uint32_t) + slots.capacity() * sizeof(uint32_t);
+    }
+};
@@ -0,0 +1,257 @@
+// external-utils.hpp
+// trshpnd 2024
+//
+// Ordenação externa das avaliações, para arquivos de ratings maiores que a memória. As
+// linhas lidas vão para um buffer de tamanho fixo; cheio, ele é ordenado por user_id e
+// gravado em disco como uma run. No fim, as runs são intercaladas (k-way merge) direto
+// para um arquivo no layout CSR do RatingStore, que passa a usá-lo via mmap. A memória
+// usada fica limitada ao orçamento informado, qualquer que seja o tamanho da entrada (fora
+// a tabela de usuários e os offsets, proporcionais ao número de usuários).
+//
+// Layout do arquivo de avaliações:
+//   ExternalHeader | Rating[ratingCount] | uint64_t offsets[userCount + 1]
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "hash-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#define EXTERNAL_MAGIC          "CPDRATE"
+#define EXTERNAL_MIN_BLOCK      (64 * 1024)     // Menor bloco de leitura por run no merge.
+#define EXTERNAL_MIN_MEMORY     (1 << 20)
+
+struct ExternalHeader {
+    char     magic[8];
+    uint64_t userCount;
+    uint64_t ratingCount;
+};
+
+// Uma linha do arquivo de ratings.
+struct RatingRecord {
+    int user_id;
+    Rating rating;
+};
+
+// Escrita sequencial de registros em blocos.
+class RecordWriter {
+private:
+    ofstream out;
+    vector<RatingRecord> block;
+
+public:
+    RecordWriter(const string &path, size_t blockRecords) : out(path, ios::binary | ios::trunc) {
+        block.reserve(blockRecords);
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    void write(const RatingRecord &record) {
+        block.push_back(record);
+        if (block.size() == block.capacity()) flush();
+    }
+
+    void flush() {
+        out.write((const char*) block.data(), block.size() * sizeof(RatingRecord));
+        block.clear();
+    }
+
+    bool close() {
+        flush();
+        out.close();
+        return !out.fail();
+    }
+};
+
+// Leitura sequencial de uma run em blocos.
+class RecordReader {
+private:
+    ifstream in;
+    vector<RatingRecord> block;
+    size_t pos = 0;
+
+    void fill() {
+        block.resize(block.capacity());
+        in.read((char*) block.data(), block.size() * sizeof(RatingRecord));
+        block.resize(in.gcount() / sizeof(RatingRecord));
+        pos = 0;
+    }
+
+public:
+    RecordReader(const string &path, size_t blockRecords) : in(path, ios::binary) {
+        block.reserve(blockRecords);
+        fill();
+    }
+
+    bool atEnd() const { return pos >= block.size(); }
+    const RatingRecord& current() const { return block[pos]; }
+
+    void next() {
+        if (++pos >= block.size()) fill();
+    }
+};
+
+class ExternalRatingSorter {
+private:
+    string spillDir;
+    size_t memoryBytes;
+    vector<RatingRecord> buffer;
+    vector<string> runs;
+    size_t runCounter = 0;
+    bool failed = false;
+
+    string nextRunPath() {
+        return spillDir + "/ratings-run-" + to_string(runCounter++) + ".tmp";
+    }
+
+    // Ordena o buffer por usuário (estável: as avaliações de cada usuário ficam na ordem
+    // do arquivo) e grava a run.
+    void spill() {
+        if (buffer.empty()) return;
+        stable_sort(buffer.begin(), buffer.end(), [](const RatingRecord &a, const RatingRecord &b) { return a.user_id < b.user_id; });
+
+        string path = nextRunPath();
+        RecordWriter writer(path, EXTERNAL_MIN_BLOCK / sizeof(RatingRecord));
+        if (!writer.isOpen()) failed = true;
+        for (const auto &record : buffer) writer.write(record);
+        if (!writer.close()) failed = true;
+
+        runs.push_back(path);
+        buffer.clear();
+    }
+
+    // Intercala as runs [first, last) chamando emit(registro) em ordem de user_id. Empates
+    // saem na ordem das runs, que é a ordem do arquivo.
+    template <typename Emit>
+    void merge(size_t first, size_t last, Emit emit) {
+        size_t count = last - first;
+        size_t blockRecords = max<size_t>(EXTERNAL_MIN_BLOCK, memoryBytes / (count + 1)) / sizeof(RatingRecord);
+
+        vector<unique_ptr<RecordReader>> readers;
+        for (size_t r = first; r < last; r++) readers.emplace_back(new RecordReader(runs[r], blockRecords));
+
+        // (user_id, run) no topo do heap: menor primeiro.
+        auto later = [&](size_t a, size_t b) {
+            int userA = readers[a]->current().user_id, userB = readers[b]->current().user_id;
+            return userA != userB ? userA > userB : a > b;
+        };
+        priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+        for (size_t r = 0; r < count; r++) {
+            if (!readers[r]->atEnd()) heap.push(r);
+        }
+
+        while (!heap.empty()) {
+            size_t r = heap.top();
+            heap.pop();
+            emit(readers[r]->current());
+            readers[r]->next();
+            if (!readers[r]->atEnd()) heap.push(r);
+        }
+
+        readers.clear();
+        for (size_t r = first; r < last; r++) remove(runs[r].c_str());
+    }
+
+public:
+    // 'memoryBytes': orçamento para o buffer de ordenação e os blocos do merge.
+    ExternalRatingSorter(const string &dir, size_t memory) : spillDir(dir), memoryBytes(max<size_t>(memory, EXTERNAL_MIN_MEMORY)) {
+        // Metade para os registros, metade para o buffer auxiliar do stable_sort.
+        buffer.reserve(memoryBytes / 2 / sizeof(RatingRecord));
+    }
+
+    ~ExternalRatingSorter() {
+        for (const auto &path : runs) remove(path.c_str());
+    }
+
+    void add(int user_id, const Rating &oRating) {
+        buffer.push_back({user_id, oRating});
+        if (buffer.size() == buffer.capacity()) spill();
+    }
+
+    size_t runCount() const { return runs.size(); }
+
+    // Grava o arquivo de avaliações em 'path', cria os usuários (índices densos em ordem
+    // crescente de user_id) e associa o arquivo ao RatingStore. Retorna false em erro de E/S.
+    bool finish(const string &path, HashTable<User> &usersHash, RatingStore &ratingStore) {
+        spill();
+        vector<RatingRecord>().swap(buffer);
+
+        // Se houver runs demais para blocos de EXTERNAL_MIN_BLOCK, intercala em grupos antes.
+        // Cada grupo vira uma run no lugar dele, então a ordem das runs continua sendo a
+        // ordem do arquivo e os empates do merge final também.
+        size_t fanIn = max<size_t>(2, memoryBytes / EXTERNAL_MIN_BLOCK - 1);
+        while (runs.size() > fanIn) {
+            vector<string> grouped;
+            for (size_t first = 0; first < runs.size(); first += fanIn) {
+                size_t last = min(runs.size(), first + fanIn);
+                if (last - first == 1) {
+                    grouped.push_back(runs[first]);
+                    continue;
+                }
+                string merged = nextRunPath();
+                RecordWriter writer(merged, EXTERNAL_MIN_BLOCK / sizeof(RatingRecord));
+                merge(first, last, [&](const RatingRecord &record) { writer.write(record); });
+                if (!writer.close()) failed = true;
+                grouped.push_back(merged);
+            }
+            runs = std::move(grouped);
+        }
+
+        ExternalHeader header = {};
+        memcpy(header.magic, EXTERNAL_MAGIC, sizeof(EXTERNAL_MAGIC));
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write((const char*) &header, sizeof(header));
+
+        // offsets[i] é o início do usuário i; o fim de cada usuário entra quando o próximo começa.
+        vector<uint64_t> offsets(1, 0);
+        vector<Rating> block;
+        block.reserve(EXTERNAL_MIN_BLOCK / sizeof(Rating));
+        bool first = true;
+        int lastUser = 0;
+        merge(0, runs.size(), [&](const RatingRecord &record) {
+            if (first || record.user_id != lastUser) {
+                if (!first) offsets.push_back(header.ratingCount);
+                first = false;
+                lastUser = record.user_id;
+                hashInsert(usersHash, User{record.user_id, (int) offsets.size() - 1});
+            }
+            block.push_back(record.rating);
+            header.ratingCount++;
+            if (block.size() == block.capacity()) {
+                out.write((const char*) block.data(), block.size() * sizeof(Rating));
+                block.clear();
+            }
+        });
+        out.write((const char*) block.data(), block.size() * sizeof(Rating));
+        if (!first) offsets.push_back(header.ratingCount);
+        runs.clear();
+
+        header.userCount = offsets.size() - 1;
+        out.write((const char*) offsets.data(), offsets.size() * sizeof(uint64_t));
+        out.seekp(0);
+        out.write((const char*) &header, sizeof(header));
+        out.close();
+        if (out.fail() || failed) return false;
+
+        auto mapping = make_shared<const MappedFile>(path);
+        if (mapping->size() != sizeof(header) + header.ratingCount * sizeof(Rating) + (header.userCount + 1) * sizeof(uint64_t)) return false;
+
+        const Rating* entries = (const Rating*) (mapping->data() + sizeof(header));
+        const uint64_t* fileOffsets = (const uint64_t*) (entries + header.ratingCount);
+        ratingStore.attach(mapping, fileOffsets, entries, header.userCount);
+        return true;
+    }
+};
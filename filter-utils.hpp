@@ -0,0 +1,91 @@
+// filter-utils.hpp
+// trshpnd 2024
+//
+// Índice de filtros do 'top': para cada posição e para cada valor de nacionalidade, clube
+// e liga, a PostingList comprimida com os índices dos jogadores que o têm. Os valores são
+// comparados sem diferenciar maiúsculas: cada coluna tem um dicionário dos valores em
+// minúsculas, e os códigos do PlayerStore que só diferem na caixa caem na mesma lista.
+// As listas não dependem das notas, então não mudam com novas avaliações; um filtro é a
+// interseção das listas dos seus predicados. O índice não muda depois de montado, então
+// as cópias o compartilham.
+
+#pragma once
+
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "position-utils.hpp"
+#include "posting-utils.hpp"
+#include "dictionary-utils.hpp"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+
+using namespace std;
+
+class FilterIndex {
+private:
+    struct Data {
+        PostingList positionLists[POSITION_COUNT];
+        StringDictionary folded[PLAYER_CATEGORY_FIELDS];    // Valor em minúsculas -> código da lista.
+        vector<PostingList> lists[PLAYER_CATEGORY_FIELDS];
+    };
+    shared_ptr<const Data> data = make_shared<const Data>();
+
+public:
+    // Monta as listas a partir dos jogadores.
+    void build(const PlayerStore &players){
+        auto built = make_shared<Data>();
+        PostingList* positionLists = built->positionLists;
+        StringDictionary* folded = built->folded;
+        vector<PostingList>* lists = built->lists;
+
+        vector<vector<int>> buckets(POSITION_COUNT);
+        for(int index = 0; index < (int) players.size(); index++){
+            uint16_t mask = parsePositions(players.text(index, PLAYER_POSITIONS));
+            for(int code = 0; code < POSITION_COUNT; code++){
+                if(mask & (1u << code)) buckets[code].push_back(index);
+            }
+        }
+        for(int code = 0; code < POSITION_COUNT; code++) positionLists[code] = PostingList(buckets[code]);
+
+        for(int c = 0; c < PLAYER_CATEGORY_FIELDS; c++){
+            PlayerField field = (PlayerField) (PLAYER_FREE_FIELDS + c);
+            const StringDictionary &category = players.category(field);
+
+            // Código do PlayerStore -> código do valor em minúsculas.
+            vector<uint32_t> foldedCode(category.size());
+            for(uint32_t code = 0; code < category.size(); code++) foldedCode[code] = folded[c].insert(toLowerCase(category.value(code)));
+
+            buckets.assign(folded[c].size(), vector<int>());
+            const vector<uint32_t> &column = players.codeColumn(field);
+            for(int index = 0; index < (int) column.size(); index++) buckets[foldedCode[column[index]]].push_back(index);
+
+            for(const auto &bucket : buckets) lists[c].emplace_back(bucket);
+        }
+        data = std::move(built);
+    }
+
+    const PostingList* position(int code) const{
+        return &data->positionLists[code];
+    }
+
+    // Lista dos jogadores com o valor (sem diferenciar maiúsculas), ou nullptr se nenhum
+    // jogador o tiver. 'field' é NATIONALITY, CLUB_NAME ou LEAGUE_NAME.
+    const PostingList* find(PlayerField field, string_view value) const{
+        int c = field - PLAYER_FREE_FIELDS;
+        uint32_t code = data->folded[c].find(toLowerCase(value));
+        return code == DICTIONARY_NONE ? nullptr : &data->lists[c][code];
+    }
+
+    size_t memoryBytes() const{
+        size_t bytes = 0;
+        for(const auto &list : data->positionLists) bytes += list.memoryBytes();
+        for(int c = 0; c < PLAYER_CATEGORY_FIELDS; c++){
+            bytes += data->folded[c].memoryBytes();
+            for(const auto &list : data->lists[c]) bytes += sizeof(PostingList) + list.memoryBytes();
+        }
+        return bytes;
+    }
+};
@@ -1,100 +1,222 @@
 // hash-utils.hpp
 // trshpnd 2024
+//
+// Tabela hash de endereçamento aberto, no estilo SwissTable. Os itens ficam em um único
+// vetor contíguo ('slots') e, em paralelo, um vetor de metadados ('ctrl') guarda um byte
+// por slot: CTRL_EMPTY ou os 7 bits baixos do hash da chave. A busca compara 16 bytes
+// de metadados por vez (SSE2) e só acessa os slots cujo byte coincide.
+// A capacidade é sempre potência de 2 e a tabela dobra quando passa de 7/8 de ocupação.
+
+#pragma once
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+#define HASH_GROUP_WIDTH    16
+#define CTRL_EMPTY          ((int8_t) -128)
+
 template <typename T>
 struct HashTable{
-    vector<vector<T>> table;
-
-    HashTable(size_t tableSize){
-        table.resize(tableSize);
+    vector<int8_t> ctrl;    // capacity + HASH_GROUP_WIDTH bytes; o final espelha o início.
+    vector<T> slots;
+    size_t mask;            // capacity - 1
+    size_t count = 0;
+
+    // 'expected': número de itens esperado. A tabela cresce se for ultrapassado.
+    HashTable(size_t expected = 16){
+        size_t capacity = HASH_GROUP_WIDTH;
+        while(capacity * 7 / 8 < expected) capacity *= 2;
+
+        ctrl.assign(capacity + HASH_GROUP_WIDTH, CTRL_EMPTY);
+        slots.resize(capacity);
+        mask = capacity - 1;
     }
+
+    size_t capacity() const { return mask + 1; }
 };
 
-// Retorna o indice para a inserção do item na tabela hash.
-unsigned long long polynomialHash(int number, int mod, int base = 31){
-    unsigned long long hashIndex = 0;
-    unsigned long long basePower = 1;
+// Mistura os bits da chave (finalizador do MurmurHash3). Chaves sequenciais se
+// espalham por toda a tabela.
+inline uint64_t hashMix(uint64_t key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
 
-    while (number > 0) {
-        int digit = number % 10;
-        hashIndex = (hashIndex + digit * basePower) % mod;
-        basePower = (basePower * base) % mod;
-        number /= 10;
+// Máscara de bits com as posições do grupo de 16 bytes iniciado em 'group' iguais a 'value'.
+inline uint32_t ctrlMatch(const int8_t* group, int8_t value){
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i*) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value)));
+#else
+    uint32_t matches = 0;
+    for(int i = 0; i < HASH_GROUP_WIDTH; i++){
+        if(group[i] == value) matches |= 1u << i;
     }
+    return matches;
+#endif
+}
 
-    return hashIndex;
+inline void setCtrl(vector<int8_t> &ctrl, size_t mask, size_t index, int8_t value){
+    ctrl[index] = value;
+    // Os primeiros bytes são espelhados após o fim para que um grupo possa ser lido sem dar a volta.
+    if(index < HASH_GROUP_WIDTH) ctrl[mask + 1 + index] = value;
 }
 
-// Insere o item na tabela.
+// Retorna o índice do slot com a chave, ou -1. 'probes' recebe o número de grupos visitados.
 template <typename T>
-void hashInsert(HashTable<T> &hashTable, T oItem){
-    int hashIndex = polynomialHash(oItem.id, hashTable.table.size());
-    hashTable.table[hashIndex].push_back(oItem);
+long long hashFind(const HashTable<T> &hashTable, int key, int &probes){
+    uint64_t hash = hashMix((uint32_t) key);
+    int8_t h2 = hash & 0x7F;
+    size_t pos = (hash >> 7) & hashTable.mask;
+    size_t step = 0;
+
+    for(probes = 1; ; probes++){
+        const int8_t* group = hashTable.ctrl.data() + pos;
+
+        for(uint32_t matches = ctrlMatch(group, h2); matches != 0; matches &= matches - 1){
+            size_t index = (pos + __builtin_ctz(matches)) & hashTable.mask;
+            if(hashTable.slots[index].id == key) return index;
+        }
+        if(ctrlMatch(group, CTRL_EMPTY) != 0) return -1;
+
+        // Sondagem triangular por grupos: visita todos os grupos da tabela.
+        step += HASH_GROUP_WIDTH;
+        pos = (pos + step) & hashTable.mask;
+    }
 }
 
-// Função de busca. Receba uma HashTable, uma chave (int) e um ponteiro para o item.
-// O item é retornado por referência.
+// Posiciona o item no primeiro slot vazio da sequência de sondagem, sem realocar.
 template <typename T>
-void hashSearch(HashTable<T> &hashTable, int key, T* &oItem){
-    bool found = false;
+void hashPlace(HashTable<T> &hashTable, T &&oItem){
+    uint64_t hash = hashMix((uint32_t) oItem.id);
+    size_t pos = (hash >> 7) & hashTable.mask;
+    size_t step = 0;
+
+    while(true){
+        uint32_t empty = ctrlMatch(hashTable.ctrl.data() + pos, CTRL_EMPTY);
+        if(empty != 0){
+            size_t index = (pos + __builtin_ctz(empty)) & hashTable.mask;
+            setCtrl(hashTable.ctrl, hashTable.mask, index, hash & 0x7F);
+            hashTable.slots[index] = std::move(oItem);
+            hashTable.count++;
+            return;
+        }
+        step += HASH_GROUP_WIDTH;
+        pos = (pos + step) & hashTable.mask;
+    }
+}
 
-    int hashIndex = polynomialHash(key, hashTable.table.size());
+// Dobra a capacidade e reinsere todos os itens.
+template <typename T>
+void hashGrow(HashTable<T> &hashTable){
+    HashTable<T> bigger((hashTable.capacity() * 2) * 7 / 8);
 
-    if(!hashTable.table[hashIndex].empty()){
-        for(auto &item : hashTable.table[hashIndex]){
-            if(item.id == key){
-                oItem = &item;      // pointer to target
-                found = true;
-                break;
-            }
-        }
-        if(!found) oItem = nullptr; // Retorna nullptr quando não encontrado.
+    for(size_t i = 0; i < hashTable.capacity(); i++){
+        if(hashTable.ctrl[i] != CTRL_EMPTY) hashPlace(bigger, std::move(hashTable.slots[i]));
     }
-    else oItem = nullptr;          // Retorna null pointer quando vazio.
+    hashTable = std::move(bigger);
 }
 
-// Função de avaliação dos stats da hash table. Apenas para debug. 
+// Insere o item na tabela. Como antes, não verifica se a chave já existe.
+// A inserção pode realocar a tabela e invalidar ponteiros obtidos por hashSearch.
 template <typename T>
-void hashStats(HashTable<T> hashTable, bool verbose = false){
-    int empty = 0;
-    int maxListSize = 0;
-    int entries = 0;
-    int avgListSize = 0;
+void hashInsert(HashTable<T> &hashTable, T oItem){
+    if((hashTable.count + 1) > hashTable.capacity() * 7 / 8) hashGrow(hashTable);
+    hashPlace(hashTable, std::move(oItem));
+}
 
-    for(int i = 0; i < hashTable.table.size(); i++){
+// Função de busca. Receba uma HashTable, uma chave (int) e um ponteiro para o item.
+// O item é retornado por referência; nullptr quando não encontrado.
+template <typename T>
+void hashSearch(HashTable<T> &hashTable, int key, T* &oItem){
+    int probes;
+    long long index = hashFind(hashTable, key, probes);
+    oItem = (index >= 0) ? &hashTable.slots[index] : nullptr;
+}
 
-        if(verbose != false){
-            cout << i << "\t";
-        }
+template <typename T>
+void hashSearch(const HashTable<T> &hashTable, int key, const T* &oItem){
+    int probes;
+    long long index = hashFind(hashTable, key, probes);
+    oItem = (index >= 0) ? &hashTable.slots[index] : nullptr;
+}
 
-        if(!hashTable.table[i].empty()){
+// Percorre todos os itens da tabela, na ordem dos slots.
+template <typename T, typename Function>
+void hashForEach(HashTable<T> &hashTable, Function fn){
+    for(size_t i = 0; i < hashTable.capacity(); i++){
+        if(hashTable.ctrl[i] != CTRL_EMPTY) fn(hashTable.slots[i]);
+    }
+}
 
-            if(hashTable.table[i].size() > maxListSize){
-                maxListSize = hashTable.table[i].size();
-            }
+template <typename T, typename Function>
+void hashForEach(const HashTable<T> &hashTable, Function fn){
+    for(size_t i = 0; i < hashTable.capacity(); i++){
+        if(hashTable.ctrl[i] != CTRL_EMPTY) fn(hashTable.slots[i]);
+    }
+}
 
-            for(const auto &item : hashTable.table[i]){
-                entries++;
-                if(verbose != false){
-                    cout << item.id << "\t";
-                }
-            }
-        }else empty++;
+struct HashStats{
+    size_t entries = 0;
+    size_t capacity = 0;
+    size_t bytes = 0;
+    int maxProbes = 0;
+    double avgProbes = 0;
+    vector<size_t> probeHistogram;  // probeHistogram[k]: itens encontrados após k+1 grupos.
+};
 
-        if(verbose != false) cout << endl;
+// Estatísticas da tabela: ocupação e distribuição do comprimento de sondagem (em grupos
+// de 16 slots) necessário para encontrar cada item.
+template <typename T>
+HashStats hashStats(const HashTable<T> &hashTable){
+    HashStats stats;
+    size_t totalProbes = 0;
+
+    stats.capacity = hashTable.capacity();
+    stats.bytes = hashTable.ctrl.size() + hashTable.slots.size() * sizeof(T);
+
+    hashForEach(hashTable, [&](const T &item){
+        int probes;
+        hashFind(hashTable, item.id, probes);
+
+        if((size_t) probes > stats.probeHistogram.size()) stats.probeHistogram.resize(probes, 0);
+        stats.probeHistogram[probes - 1]++;
+        stats.maxProbes = max(stats.maxProbes, probes);
+        totalProbes += probes;
+        stats.entries++;
+    });
+
+    if(stats.entries > 0) stats.avgProbes = (double) totalProbes / stats.entries;
+    return stats;
+}
+
+void printHashStats(const HashStats &stats, ostream &out = cout){
+    out << "Total Entries: \t" << stats.entries << endl;
+    out << "Capacity:      \t" << stats.capacity << endl;
+    out << "Load Factor:   \t" << (stats.capacity ? (double) stats.entries / stats.capacity : 0) << endl;
+    out << "Avg Probes:    \t" << stats.avgProbes << endl;
+    out << "Max Probes:    \t" << stats.maxProbes << endl;
+    for(size_t k = 0; k < stats.probeHistogram.size(); k++){
+        out << "  " << k + 1 << " grupo(s): \t" << stats.probeHistogram[k] << endl;
     }
+    out << "------------------------" << endl;
+}
 
-    avgListSize = entries/(hashTable.table.size() - empty);
-    
-    cout << "Total Entries: \t" << entries << endl;
-    cout << "Max List Size: \t" << maxListSize << endl;
-    cout << "Avg List Size: \t" << avgListSize << endl;
-    cout << "Empty Indexes: \t" << empty << endl;
-    cout << "------------------------" << endl;
+void printHashStatsJson(const HashStats &stats, ostream &out = cout){
+    out << "{\"entries\": " << stats.entries << ", \"capacity\": " << stats.capacity << ", \"bytes\": " << stats.bytes
+        << ", \"avg_probes\": " << stats.avgProbes << ", \"max_probes\": " << stats.maxProbes << ", \"probe_histogram\": [";
+    for(size_t k = 0; k < stats.probeHistogram.size(); k++) out << (k ? ", " : "") << stats.probeHistogram[k];
+    out << "]}";
 }
\ No newline at end of file
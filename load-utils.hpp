@@ -0,0 +1,430 @@
+// load-utils.hpp
+// trshpnd 2024
+//
+// Construção da Database a partir dos CSVs: jogadores, avaliações (carga paralela em
+// duas passadas para o RatingStore), trie de nomes e índice de tags. Usado pelo main e
+// pelo benchmark.
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "hash-utils.hpp"
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "tag-utils.hpp"
+#include "dictionary-utils.hpp"
+#include "query-utils.hpp"
+#include "stats-utils.hpp"
+#include "external-utils.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+#define PREFIX_TOP_K        32  // Tamanho do ranking guardado em cada nodo da trie de nomes.
+#define PROGRESS_ROWS       65536   // Linhas entre atualizações do andamento da carga.
+
+// Agregados parciais de um worker da carga paralela de ratings.
+struct PlayerTotals{
+    int id;
+    int total_ratings = 0;
+    float rating = 0;
+};
+
+// Contagem de avaliações de um usuário dentro de um chunk. Entre as duas passadas,
+// 'cursor' recebe a posição no RatingStore onde a primeira avaliação do chunk é gravada.
+struct UserCount{
+    int id;
+    int index = 0;
+    uint64_t count = 0;
+    uint64_t cursor = 0;
+};
+
+struct RatingChunk{
+    const char* begin;
+    const char* end;
+    HashTable<UserCount>    users;
+    HashTable<PlayerTotals> players;
+    vector<int> user_order;     // ids de usuario na ordem da primeira ocorrencia no chunk.
+    atomic<size_t>* progress = nullptr;     // Bytes lidos, somados nas duas passadas.
+
+    RatingChunk(const char* b, const char* e, size_t M, size_t N) : begin(b), end(e), users(N), players(M) {}
+};
+
+// Lê uma linha do arquivo de ratings (user_id, sofifa_id, rating). Retorna false se
+// a linha estiver vazia ou mal formada; a leitura sempre avança para a próxima linha.
+bool readRatingRow(CsvReader &reader, int &user_id, Rating &oRating){
+    string_view field;
+    bool ok = reader.nextField(field) && parseInt(field, user_id)
+           && reader.nextField(field) && parseInt(field, oRating.id)
+           && reader.nextField(field) && parseFloat(field, oRating.rating);
+    reader.nextRow();
+    return ok;
+}
+
+// Soma ao andamento os bytes lidos desde a última atualização.
+void reportProgress(RatingChunk &chunk, const CsvReader &reader, const char* &reported){
+    if(!chunk.progress) return;
+    *chunk.progress += reader.position() - reported;
+    reported = reader.position();
+}
+
+// Passada 1: conta as avaliações de cada usuário do chunk e acumula soma/contagem por
+// jogador. Nenhuma estrutura compartilhada é alterada aqui.
+void countRatingChunk(RatingChunk &chunk){
+    CsvReader reader(chunk.begin, chunk.end);
+    int user_id;
+    Rating oRating;
+    const char* reported = chunk.begin;
+    size_t rows = 0;
+
+    while(!reader.atEnd()){
+        if(!readRatingRow(reader, user_id, oRating)) continue;
+        if(++rows % PROGRESS_ROWS == 0) reportProgress(chunk, reader, reported);
+
+        UserCount* userptr = nullptr;
+        hashSearch(chunk.users, user_id, userptr);
+
+        if(!userptr){
+            UserCount oUser;
+            oUser.id = user_id;
+            hashInsert(chunk.users, oUser);
+            hashSearch(chunk.users, user_id, userptr);
+            chunk.user_order.push_back(user_id);
+        }
+        userptr->count++;
+
+        PlayerTotals* totalsptr = nullptr;
+        hashSearch(chunk.players, oRating.id, totalsptr);
+
+        if(!totalsptr){
+            PlayerTotals oTotals;
+            oTotals.id = oRating.id;
+            hashInsert(chunk.players, oTotals);
+            hashSearch(chunk.players, oRating.id, totalsptr);
+        }
+        totalsptr->total_ratings++;
+        totalsptr->rating = oRating.rating + totalsptr->rating;
+    }
+    reportProgress(chunk, reader, reported);
+}
+
+// Passada 2: reparseia o chunk e grava cada avaliação na posição final do seu usuário.
+// Os intervalos de escrita de chunks diferentes são disjuntos.
+void scatterRatingChunk(RatingChunk &chunk, Rating* entries){
+    CsvReader reader(chunk.begin, chunk.end);
+    int user_id;
+    Rating oRating;
+    const char* reported = chunk.begin;
+    size_t rows = 0;
+
+    while(!reader.atEnd()){
+        if(!readRatingRow(reader, user_id, oRating)) continue;
+        if(++rows % PROGRESS_ROWS == 0) reportProgress(chunk, reader, reported);
+
+        UserCount* userptr = nullptr;
+        hashSearch(chunk.users, user_id, userptr);
+        entries[userptr->cursor++] = oRating;
+    }
+    reportProgress(chunk, reader, reported);
+}
+
+// Executa 'fn' em cada chunk, uma thread por chunk.
+template <typename Chunk, typename Function>
+void runOnChunks(vector<Chunk> &chunks, Function fn){
+    if(chunks.size() == 1){
+        fn(chunks[0]);
+        return;
+    }
+
+    vector<thread> workers;
+    for(auto &chunk : chunks){
+        workers.emplace_back(fn, std::ref(chunk));
+    }
+    for(auto &worker : workers) worker.join();
+}
+
+// Carga de ratings em duas passadas sobre chunks alinhados a linhas, processados em
+// paralelo. A primeira conta avaliações por usuário; com as contagens, os índices densos
+// dos usuários (ordem da primeira ocorrência no arquivo) e os offsets do RatingStore são
+// definidos, e a segunda passada grava cada avaliação direto na posição final. As listas
+// de cada usuário ficam na ordem do arquivo.
+// As notas são múltiplos de 0.5, então as somas em float são exatas e independem da ordem.
+// 'progress' (opcional) recebe os bytes lidos nas duas passadas (até 2x o tamanho do
+// arquivo); 'afterTotals' é chamada entre as passadas, quando a soma e a contagem de cada
+// jogador já estão em playerStore.
+void loadRatings(PlayerStore &playerStore, HashTable<User> &usersHash, RatingStore &ratingStore, const MappedFile &file, int nThreads,
+                 atomic<size_t>* progress = nullptr, const function<void()> &afterTotals = nullptr){
+    vector<size_t> bounds = splitIntoChunks(file, nThreads);
+
+    // Tabelas locais menores que as globais: cada chunk vê apenas parte dos dados. A tabela
+    // global ainda está vazia; a capacidade dela é o número esperado de usuários.
+    size_t expectedUsers = usersHash.capacity() * 7 / 8;
+    vector<RatingChunk> chunks;
+    chunks.reserve(nThreads);
+    for(int i = 0; i < nThreads; i++){
+        chunks.emplace_back(file.data() + bounds[i], file.data() + bounds[i+1], playerStore.size(), expectedUsers / nThreads + 1);
+        chunks.back().progress = progress;
+    }
+
+    runOnChunks(chunks, countRatingChunk);
+
+    // Índices densos e contagem total por usuário, na ordem dos chunks.
+    vector<uint64_t> counts;
+    for(auto &chunk : chunks){
+        for(int id : chunk.user_order){
+            UserCount* localptr = nullptr;
+            User* userptr = nullptr;
+
+            hashSearch(chunk.users, id, localptr);
+            hashSearch(usersHash, id, userptr);
+
+            if(!userptr){
+                User oUser;
+                oUser.id = id;
+                oUser.index = counts.size();
+                hashInsert(usersHash, oUser);
+                counts.push_back(0);
+                localptr->index = oUser.index;
+            }
+            else localptr->index = userptr->index;
+
+            counts[localptr->index] += localptr->count;
+        }
+
+        hashForEach(chunk.players, [&](const PlayerTotals &totals){
+            int index = playerStore.find(totals.id);
+
+            if(index >= 0){
+                playerStore.setTotalRatings(index, playerStore.totalRatings(index) + totals.total_ratings);
+                playerStore.setRating(index, totals.rating + playerStore.rating(index));
+            }
+        });
+    }
+
+    if(afterTotals) afterTotals();
+    ratingStore.allocate(counts);
+
+    // Cursores de escrita: o chunk c começa após as avaliações do usuário nos chunks anteriores.
+    vector<uint64_t> next(ratingStore.offsets(), ratingStore.offsets() + counts.size());
+    for(auto &chunk : chunks){
+        hashForEach(chunk.users, [&](UserCount &local){
+            local.cursor = next[local.index];
+            next[local.index] += local.count;
+        });
+    }
+
+    Rating* entries = ratingStore.mutableEntries();
+    runOnChunks(chunks, [entries](RatingChunk &chunk){ scatterRatingChunk(chunk, entries); });
+}
+
+// Carga de ratings em memória externa, para arquivos maiores que a memória: a soma e a
+// contagem de cada jogador são acumuladas durante a leitura, e as avaliações passam pelo
+// ExternalRatingSorter, que grava o arquivo 'ratings.bin' em 'spillDir' e o associa ao
+// RatingStore. A memória usada fica em torno de 'memoryBytes'. Retorna false em erro de E/S.
+bool loadRatingsExternal(PlayerStore &playerStore, HashTable<User> &usersHash, RatingStore &ratingStore, const MappedFile &file, size_t memoryBytes, const string &spillDir){
+    ExternalRatingSorter sorter(spillDir, memoryBytes);
+    CsvReader reader(file);
+    reader.nextRow();   // Pula o cabeçalho.
+
+    int user_id;
+    Rating oRating;
+    while(!reader.atEnd()){
+        if(!readRatingRow(reader, user_id, oRating)) continue;
+
+        int index = playerStore.find(oRating.id);
+        if(index >= 0){
+            playerStore.setTotalRatings(index, playerStore.totalRatings(index) + 1);
+            playerStore.setRating(index, oRating.rating + playerStore.rating(index));
+        }
+        sorter.add(user_id, oRating);
+    }
+    return sorter.finish(spillDir + "/ratings.bin", usersHash, ratingStore);
+}
+
+// Lê o arquivo de jogadores para o PlayerStore (sem avaliações).
+void loadPlayers(PlayerStore &playerStore, string player_dir, vector<PhaseTiming>* phases = nullptr){
+    MappedFile f(player_dir);
+
+    int oSofifa_id;
+    string text[PLAYER_TEXT_FIELDS];
+    string_view textViews[PLAYER_TEXT_FIELDS];
+    string_view field;
+
+    cout << "Processando " << player_dir << "... ";
+    timePhase(phases, player_dir, [&]{
+        CsvReader parser(f);
+        parser.nextRow();   // Pula o cabeçalho.
+
+        while(!parser.atEnd()){
+            // Field 1: sofifa_id
+            if(!parser.nextField(field) || !parseInt(field, oSofifa_id)){
+                parser.nextRow();
+                continue;
+            }
+
+            // Fields 2-7: short_name, long_name, player_positions, nationality, club_name, league_name.
+            // O campo só é válido até a próxima leitura, então é copiado para 'text'.
+            for(int i = 0; i < PLAYER_TEXT_FIELDS; i++){
+                if(!parser.nextField(field)) field = string_view();
+                text[i] = field;
+                textViews[i] = text[i];
+            }
+
+            parser.nextRow();
+            playerStore.add(oSofifa_id, textViews);
+        }
+        return playerStore.size();
+    });
+    cout << "Pronto." << endl;
+}
+
+// Troca a soma das notas (acumulada em 'rating' pela carga) pela média de cada jogador.
+void computeAverages(PlayerStore &playerStore){
+    for(int index = 0; index < (int) playerStore.size(); index++){
+        playerStore.setRatingSum(index, playerStore.rating(index));
+    }
+}
+
+// nThreads > 1 ativa a carga paralela do arquivo de ratings. Se 'phases' for informado,
+// registra o tempo e o número de linhas de cada arquivo. memoryLimit > 0 troca a carga de
+// ratings pela carga em memória externa, com os arquivos temporários em 'spillDir'.
+void buildHash(PlayerStore &playerStore, HashTable<User> &usersHash, RatingStore &ratingStore, string player_dir, string rating_dir, int nThreads = 1,
+               vector<PhaseTiming>* phases = nullptr, size_t memoryLimit = 0, string spillDir = "."){
+    loadPlayers(playerStore, player_dir, phases);
+
+    MappedFile g(rating_dir);
+    cout << "Processando " << rating_dir << "... ";
+
+    timePhase(phases, rating_dir, [&]{
+        if(memoryLimit > 0 && !loadRatingsExternal(playerStore, usersHash, ratingStore, g, memoryLimit, spillDir)){
+            // Desfaz a carga parcial e volta para a carga em memória.
+            cout << "Falha na gravacao em " << spillDir << "; usando a carga em memoria... ";
+            for(int index = 0; index < (int) playerStore.size(); index++){
+                playerStore.setTotalRatings(index, 0);
+                playerStore.setRating(index, 0);
+            }
+            usersHash = HashTable<User>(usersHash.count);
+            memoryLimit = 0;
+        }
+        if(memoryLimit == 0) loadRatings(playerStore, usersHash, ratingStore, g, nThreads);
+        return ratingStore.ratingCount();
+    });
+
+    cout << "Pronto." << endl;
+    cout << "Calculando media para cada jogador baseando-se nas avaliacoes de usuarios... ";
+    
+
+    // Re-itera os jogadores e calcula nota media de cada um.
+    timePhase(phases, "medias", [&]{
+        computeAverages(playerStore);
+        return (size_t) 0;
+    });
+
+    cout << "Pronto." << endl;
+}
+
+void buildPlayerTrie(const PlayerStore &playerStore, Trie &playerNames){
+    for(int index = 0; index < (int) playerStore.size(); index++){
+        playerNames.insert(playerStore.text(index, LONG_NAME), playerStore.id(index));
+    }
+    playerNames.compact();
+}
+
+// Tags e pares (tag id local << 32 | sofifa_id) de um chunk do arquivo de tags.
+struct TagChunk{
+    const char* begin;
+    const char* end;
+    StringDictionary tags;
+    vector<uint64_t> pairs;
+    size_t rows = 0;
+};
+
+void collectTagChunk(TagChunk &chunk){
+    CsvReader parser(chunk.begin, chunk.end);
+    int oSofifa_id;
+    string_view field;
+    string tag;
+
+    while(!parser.atEnd()){
+        // Field 1: user_id [pula, não usado]
+        parser.nextField(field);
+
+        // Field 2: sofifa_id
+        if(!parser.nextField(field) || !parseInt(field, oSofifa_id) || !parser.nextField(field)){
+            parser.nextRow();
+            continue;
+        }
+
+        // Field 3: tag, normalizada em minúsculas
+        tag.assign(field);
+        transform(tag.begin(), tag.end(), tag.begin(), ::tolower);
+        chunk.pairs.push_back((uint64_t) chunk.tags.insert(tag) << 32 | (uint32_t) oSofifa_id);
+        parser.nextRow();
+        chunk.rows++;
+    }
+}
+
+// Carga das tags em lote: cada chunk do arquivo (em paralelo) dá ids locais às suas tags
+// e junta os pares (tag, jogador). As tags distintas recebem ids globais em ordem
+// alfabética, os pares são traduzidos e uma única ordenação com remoção de repetidos
+// deixa as listas de todas as tags prontas para o índice.
+void buildTagsTrie(string tags_dir, TagIndex &tagIndex, int nThreads = 1, vector<PhaseTiming>* phases = nullptr){
+    MappedFile f(tags_dir);
+
+    cout << "Processando "<< tags_dir <<"... ";
+    timePhase(phases, tags_dir, [&]{
+        vector<size_t> bounds = splitIntoChunks(f, nThreads);
+        vector<TagChunk> chunks(nThreads);
+        for(int c = 0; c < nThreads; c++){
+            chunks[c].begin = f.data() + bounds[c];
+            chunks[c].end = f.data() + bounds[c + 1];
+        }
+        runOnChunks(chunks, collectTagChunk);
+
+        // Ids globais: todas as tags distintas, em ordem alfabética.
+        StringDictionary all;
+        for(auto &chunk : chunks){
+            for(uint32_t id = 0; id < chunk.tags.size(); id++) all.insert(chunk.tags.value(id));
+        }
+        vector<string_view> tags(all.size());
+        for(uint32_t id = 0; id < all.size(); id++) tags[id] = all.value(id);
+        sort(tags.begin(), tags.end());
+
+        vector<uint32_t> finalId(all.size());
+        for(uint32_t id = 0; id < tags.size(); id++) finalId[all.find(tags[id])] = id;
+
+        // Traduz os ids locais de cada chunk e junta os pares.
+        size_t rows = 0, total = 0;
+        for(auto &chunk : chunks) total += chunk.pairs.size();
+        vector<uint64_t> pairs;
+        pairs.reserve(total);
+        for(auto &chunk : chunks){
+            vector<uint32_t> local(chunk.tags.size());
+            for(uint32_t id = 0; id < local.size(); id++) local[id] = finalId[all.find(chunk.tags.value(id))];
+            for(uint64_t pair : chunk.pairs) pairs.push_back((uint64_t) local[pair >> 32] << 32 | (uint32_t) pair);
+            vector<uint64_t>().swap(chunk.pairs);
+            rows += chunk.rows;
+        }
+
+        sort(pairs.begin(), pairs.end());
+        pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+        tagIndex.build(tags, pairs);
+        return rows;
+    });
+    cout << "Pronto." << endl;
+}
+
+// Estruturas derivadas das notas: ranking por prefixo na trie de nomes e índice por
+// posição. Não vão para o snapshot; são refeitas depois de qualquer carga.
+void buildRankings(Database &db){
+    db.playerNames.buildRanking(PREFIX_TOP_K, RankByRating{&db.players});
+    db.positionIndex.build(db.players, RankByRating{&db.players});
+}
@@ -5,218 +5,53 @@
 //      1.3. Estrutura para guardar reviews de usuários 
 //      1.4. Estrutura para guardar tags 
 // 2. Pesquisas
-//      2.1. Prefixos de nomes de jogadores - player <prefix>
-//      2.2. Jogadores revisados por usuarios - user <userID>
-//      2.3. Top jogadores de determinada posicao - top <N> <position>
+//      2.1. Prefixos de nomes de jogadores - player <prefix> [N [offset]]
+//      2.2. Jogadores revisados por usuarios - user <userID> [N]
+//      2.3. Top jogadores de determinada posicao - top <N> <position> [nation|club|league '<nome>']...
 //      2.4. Jogadores contendo x tags - tags <list of tags>
+//      2.5. Estatisticas de carga, memoria e latencia - stats [json]
+//      2.6. Paginacao e formato da saida - <pesquisa> [limit <n>] [offset <n>] [format <table|tsv|jsonl|binary>]
+//      2.7. Jogadores com um texto em qualquer parte do nome - contains <texto>
+//      2.8. Jogadores avaliados pelos mesmos usuarios - similar <sofifaID> [N] [common|corr]
+// 3. Atualizacoes
+//      3.1. Nova avaliacao - rate <userID> <sofifaID> <nota>
 //
 //      trshpnd 2024
 
-#include "csv-parser/parser.hpp"
+#include "csv-utils.hpp"
 #include "hash-utils.hpp"
 #include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "position-utils.hpp"
+#include "tag-utils.hpp"
+#include "sort-utils.hpp"
+#include "snapshot-utils.hpp"
+#include "query-utils.hpp"
+#include "load-utils.hpp"
+#include "update-utils.hpp"
+#include "batch-utils.hpp"
+#include "server-utils.hpp"
+#include "startup-utils.hpp"
 
 #include <stdlib.h>
 #include <iostream>
+#include <fstream>
 #include <chrono>
 #include <iomanip>
+#include <thread>
+#include <csignal>
+#include <unistd.h>
 
 #define PLAYERS_DIR     "arquivos-parte1//players.csv"  
 #define RATING_DIR      "rating20M//rating.csv" //"arquivos-parte1//minirating.csv"
 #define TAGS_DIR        "arquivos-parte1//tags.csv"
 
-#define ID_FIELD_WIDTH      6
-#define SHORT_FIELD_WIDTH   20
-#define LONG_FIELD_WIDTH    40
-#define POS_FIELD_WIDTH     15
-#define NATION_FIELD_WIDTH  15
-#define CLUB_FIELD_WIDTH    25
-#define LEAGUE_FIELD_WIDTH  30
-#define COUNT_FIELD_WIDTH   6
-#define RATING_FIELD_WIDTH  9
+// Pedido de parada do modo servidor (SIGINT/SIGTERM).
+atomic<bool> serverStop(false);
 
-struct Player{
-    int id;
-    string short_name;
-    string long_name;
-    string player_positions;
-    string nationality;
-    string club_name;
-    string league_name;
-    int total_ratings = 0;
-    float rating = 0; 
-};
-
-struct Rating{
-    int id;
-    float rating;
-};
-
-struct User{
-    int id;
-    vector<Rating> user_ratings;
-};
-
-void buildHash(HashTable<Player> &playersHash, HashTable<User> &usersHash, string player_dir, string rating_dir){
-    
-    using namespace aria::csv;
-
-    std::ifstream f(player_dir);
-    std::ifstream g(rating_dir);
-
-    Player oPlayer;
-
-    cout << "Processando " << player_dir << "... ";
-    CsvParser parser(f);
-
-    for(auto& row : parser){
-        auto field = parser.next_field();
-
-        // Check for EOF
-        switch(field.type){
-            case FieldType::CSV_END:
-                break; 
-        }
-
-        // Field 1: sofifa_id
-        oPlayer.id = stoi(*field.data);
-
-        // Field 2: short_name
-        field = parser.next_field();
-        oPlayer.short_name = *field.data;
-
-        // Field 3: long_name
-        field = parser.next_field();
-        oPlayer.long_name = *field.data;
-
-        // Field 4: player_positions
-        field = parser.next_field();
-        oPlayer.player_positions = *field.data;
-
-        // Field 5: nationality
-        field = parser.next_field();
-        oPlayer.nationality = *field.data;
-
-        // Field 6: club_name
-        field = parser.next_field();
-        oPlayer.club_name = *field.data;
-
-        // Field 7: league_name
-        field = parser.next_field();
-        oPlayer.league_name = *field.data;
-
-        hashInsert(playersHash, oPlayer);
-    }
-
-    cout << "Pronto. \nProcessando " << rating_dir << "... ";
-    CsvParser parser_ratings(g);
-
-    for(auto& row : parser_ratings){
-        User oUser;
-        Rating oRating;
-
-        auto field = parser_ratings.next_field();
-
-        // Check for EOF
-        switch(field.type){
-            case FieldType::CSV_END:
-                break; 
-        }
-
-        // Field 1: user_id
-        oUser.id = stoi(*field.data);
-
-        // Field 2: sofifa_id
-        field = parser_ratings.next_field();
-        oRating.id = stoi(*field.data);
-
-        // Field 3: rating
-        field = parser_ratings.next_field();
-        oRating.rating = stof(*field.data);
-
-        User* userptr = nullptr;
-
-        hashSearch(usersHash, oUser.id, userptr);
-
-        if(userptr) userptr->user_ratings.push_back(oRating); // Se o usuario ja existe, apenas adiciona o novo rating.
-        else{
-            hashInsert(usersHash, oUser); // Se usuario n existe/indice vazio, cria novo usuario e insere rating.
-            hashSearch(usersHash, oUser.id, userptr);
-            userptr->user_ratings.push_back(oRating);
-        }
-
-        Player* playerptr = nullptr;
-
-        // Pesquisa jogador no Player Hash e incrementa 'total ratings' e 'avg rating'.
-        hashSearch(playersHash, oRating.id, playerptr);
-
-        if(playerptr){
-            playerptr->total_ratings++;
-            playerptr->rating = oRating.rating + playerptr->rating;
-        }
-    }
-
-    cout << "Pronto." << endl;
-    cout << "Calculando media para cada jogador baseando-se nas avaliacoes de usuarios... ";
-    
-
-    // Re-itera player hash e calcula nota media de cada jogador.
-    for(int i = 0; i < playersHash.table.size(); ++i){
-        if(!playersHash.table[i].empty()){
-            for(auto &player : playersHash.table[i]){
-                if(player.rating != 0) player.rating = (float) player.rating/player.total_ratings;
-            }
-        }
-    }
-
-    cout << "Pronto." << endl;
-}
-
-void buildPlayerTrie(HashTable<Player> &playersHash, Trie &playerNames){
-    for(int i =0; i< playersHash.table.size();i++){
-        if(!playersHash.table[i].empty()){
-            for(const auto &player : playersHash.table[i]){
-                playerNames.insert(player.long_name, player.id);
-            }
-        }
-    }
-}
-
-void buildTagsTrie(string tags_dir, Trie &playerTags){
-    //parseia documento
-    using namespace aria::csv;
-
-    std::ifstream f(tags_dir);
-
-    int oSofifa_id;
-    string oTag;
-
-    cout << "Processando "<< tags_dir <<"... ";
-    CsvParser parser(f);
-
-    for(auto& row : parser){
-        auto field = parser.next_field();
-
-        // Check for EOF
-        switch(field.type){
-            case FieldType::CSV_END:
-                break; 
-        }
-
-        // Field 1: user_id [pula, não usado]
-
-        // Field 2: sofifa_id
-        field = parser.next_field();
-        oSofifa_id = stoi(*field.data);
-
-        // Field 3: tag
-        field = parser.next_field();
-        oTag = *field.data;
-
-        // Insere tag na trie, juntamente com o id (na folha)
-        playerTags.insert(oTag, oSofifa_id);
-    }
-    cout << "Pronto." << endl;
+void onStopSignal(int){
+    serverStop = true;
 }
 
 // Print genérico p/ debug
@@ -226,382 +61,191 @@ void printVector(vector<T> &V){
     cout << endl;
 }
 
-// Merge da função do mergesort, ordena baseado em rating.
-template <typename T>
-void merge(vector<T> &vec, int left, int mid, int right){
-    int n1 = mid - left + 1;
-    int n2 = right - mid;
-
-    vector<T> leftVec(n1);
-    vector<T> rightVec(n2);
-
-    for (int i = 0; i < n1; ++i)
-        leftVec[i] = vec[left + i];
-    for (int i = 0; i < n2; ++i)
-        rightVec[i] = vec[mid + 1 + i];
-
-    int i = 0, j = 0, k = left;
-    while (i < n1 && j < n2) {
-        if (leftVec[i].rating >= rightVec[j].rating) {
-            vec[k] = leftVec[i];
-            ++i;
-        } else {
-            vec[k] = rightVec[j];
-            ++j;
+int main(int argc, char* argv[]){
+    // Quantidades esperadas; as tabelas crescem se necessário.
+    int M = 19000;
+    int N = 140000;
+
+    // Jogadores, usuários, avaliações, tries e índices.
+    Database db(M, N);
+
+    // Opções de linha de comando.
+    // --threads <n>: número de threads da carga de ratings e do modo batch (1 = sequencial).
+    // --load-snapshot <arquivo>: carrega as estruturas do snapshot em vez dos CSVs.
+    // --save-snapshot <arquivo>: grava as estruturas em um snapshot após a carga.
+    // --batch <arquivo|->: executa as pesquisas do arquivo (ou de stdin) sem o menu.
+    // --rating-log <arquivo>: reaplica as avaliações do log na carga e grava nele as novas.
+    // --follow <arquivo>: acompanha o arquivo (tail -f) e aplica as avaliações acrescentadas.
+    // --memory-limit <MB>: carga de ratings em memória externa, limitada a MB megabytes.
+    // --spill-dir <dir>: diretório dos arquivos da carga em memória externa (padrão: atual).
+    // --serve <socket|localhost:porta>: atende clientes em vez de abrir o menu.
+    // --format <table|tsv|jsonl|binary>: formato de saída padrão do menu e do modo batch.
+    // --progressive: carga progressiva mesmo sem terminal (ver startup-utils.hpp).
+    // --similar: calcula a tabela de similares na carga a partir dos CSVs (ver similar-utils.hpp).
+    int nThreads = max(1u, thread::hardware_concurrency());
+    string loadSnapshotPath, saveSnapshotPath, batchPath, ratingLogPath, followPath, serveAddress, spillDir = ".";
+    size_t memoryLimit = 0;
+    OutputFormat format = FORMAT_TABLE;
+    bool progressive = isatty(STDIN_FILENO);
+    bool similarTable = false;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc) nThreads = max(1, atoi(argv[++i]));
+        else if(arg == "--load-snapshot" && i + 1 < argc) loadSnapshotPath = argv[++i];
+        else if(arg == "--save-snapshot" && i + 1 < argc) saveSnapshotPath = argv[++i];
+        else if(arg == "--batch" && i + 1 < argc) batchPath = argv[++i];
+        else if(arg == "--rating-log" && i + 1 < argc) ratingLogPath = argv[++i];
+        else if(arg == "--follow" && i + 1 < argc) followPath = argv[++i];
+        else if(arg == "--memory-limit" && i + 1 < argc) memoryLimit = (size_t) max(1, atoi(argv[++i])) << 20;
+        else if(arg == "--spill-dir" && i + 1 < argc) spillDir = argv[++i];
+        else if(arg == "--serve" && i + 1 < argc) serveAddress = argv[++i];
+        else if(arg == "--progressive") progressive = true;
+        else if(arg == "--similar") similarTable = true;
+        else if(arg == "--format" && i + 1 < argc){
+            int code = formatCode(argv[++i]);
+            if(code < 0){
+                cerr << "Formato desconhecido: " << argv[i] << endl;
+                return 2;
+            }
+            format = (OutputFormat) code;
         }
-        ++k;
     }
 
-    while (i < n1) {
-        vec[k] = leftVec[i];
-        ++i;
-        ++k;
-    }
+    // A carga progressiva é só do menu e da carga em memória a partir dos CSVs.
+    progressive = progressive && batchPath.empty() && serveAddress.empty() && saveSnapshotPath.empty() && memoryLimit == 0;
 
-    while (j < n2) {
-        vec[k] = rightVec[j];
-        ++j;
-        ++k;
-    }
-}
-
-template <typename T>
-void mergeSort(vector<T> &vec, int left, int right){
-    if (left < right) {
-        int mid = left + (right - left) / 2;
-
-        mergeSort(vec, left, mid);
-        mergeSort(vec, mid + 1, right);
-
-        merge(vec, left, mid, right);
-    }
-}
+    // No modo batch a saída padrão fica só com os resultados; as mensagens da carga vão para stderr.
+    streambuf* coutBuffer = cout.rdbuf();
+    if(!batchPath.empty()) cout.rdbuf(cerr.rdbuf());
 
-// Particionamento do quicksort, pivô inicia na extremidade direita do segmento.
-template <typename T>
-int partition(std::vector<T> &vec, int low, int high) {
-    T pivot = vec[high];
-    int i = low - 1;
+    auto start = chrono::high_resolution_clock::now();
 
-    for (int j = low; j < high; ++j) {
-        if (vec[j] <= pivot) {
-            ++i;
-            std::swap(vec[i], vec[j]);
-        }
+    bool loaded = false;
+    if(!loadSnapshotPath.empty()){
+        cout << "Carregando snapshot " << loadSnapshotPath << "... ";
+        timePhase(&db.phases, loadSnapshotPath, [&]{
+            loaded = loadSnapshot(loadSnapshotPath, db.players, db.users, db.userRatings, db.playerNames, db.tagIndex, db.similar);
+            return db.players.size();
+        });
+        cout << (loaded ? "Pronto." : "Reconstruindo a partir dos CSVs.") << endl;
     }
-    std::swap(vec[i + 1], vec[high]);
-    return i + 1;
-}
-
-// Quicksort genérico. Ordena vectors cujos dados não estão inseridos em um membro de classe/struct.
-template <typename T>
-void quicksort(std::vector<T> &vec, int low, int high) {
-    if (low < high) {
-        int pi = partition(vec, low, high);
 
-        quicksort(vec, low, pi - 1);
-        quicksort(vec, pi + 1, high);
+    bool background = progressive && !loaded;
+    if(background){
+        // Só os jogadores; as avaliações vêm depois, em segundo plano.
+        loadPlayers(db.players, PLAYERS_DIR, &db.phases);
+        db.loadStage = LOAD_PLAYERS;
     }
-}
-
-// Posiciona os elementos de um vetor usando os ids de outro vetor como source.
-// Emparelha os vetores para ordenação estável.
-template <typename T1, typename T2>
-void updateVectorById(vector<T1> &sourceVec, vector<T2> &toBeUpdated){
-    for(int i = 0; i < sourceVec.size(); i++){
-        for(int j = 0; j < toBeUpdated.size(); j++){
-            if(toBeUpdated[j].id == sourceVec[i].id){
-                std::swap(toBeUpdated[j], toBeUpdated[i]);
-                break;
-            }
-        }
+    else if(!loaded){
+        buildHash(db.players, db.users, db.userRatings, PLAYERS_DIR, RATING_DIR, nThreads, &db.phases, memoryLimit, spillDir);
     }
-}
-
-bool containsSubstring(const string &str, const string &substr){
-    return str.find(substr) != string::npos;
-}
-
-vector<string> parseTags(istringstream &iss) {
-    vector<string> tags;
-    string line;
-    getline(iss, line);
-
-    bool inside = false;
-    string currentTag;
-
-    for (char ch : line) {
-        if (ch == '\'') {
-            if (inside) {
-                // Fim da tag, push.
-                tags.push_back(currentTag);
-                currentTag.clear();
-            }
-            // Alterna se dentro/fora das apóstrofes.
-            inside = !inside;
-        } else if (inside) {
-            // Adiciona o caracter à tag atual.
-            currentTag += ch;
-        }
+    if(!loaded){
+        timePhase(&db.phases, "trie de nomes", [&]{ buildPlayerTrie(db.players, db.playerNames); return db.players.size(); });
+        buildTagsTrie(TAGS_DIR, db.tagIndex, nThreads, &db.phases);
     }
 
-    return tags;
-}
-
-// Realiza a interseção de 2 vectors<int>. Retorna um vector<int>.
-vector<int> intersectTwoVectors(const vector<int>& v1, const vector<int>& v2) {
-    vector<int> intersection;
-    //início e fim do v1, início e fim do v2, iterador no final do vetor 'intersection'.
-    set_intersection(v1.begin(), v1.end(), v2.begin(), v2.end(), back_inserter(intersection));
-    return intersection;
-}
-
-// Realiza a interseção de vários vectors<int>. Utiliza um vector<vector<int>> povoado
-// com diversos vector<int>.
-vector<int> intersectMultipleVectors(vector<vector<int>> vectors) {
-    if (vectors.empty()) return {};
-
-    // set_intersection funciona apenas em vectors previamente ordenados.
-    for (auto& vec : vectors) {
-        quicksort(vec, 0, (vec.size()-1));
+    // Tabela de similares, só com --similar: o cálculo custa a soma dos quadrados das
+    // avaliações de cada usuário e domina a carga. A do snapshot já vem pronta; na carga
+    // progressiva é calculada em segundo plano. A memória externa não a calcula: ela precisa
+    // de uma cópia transposta das avaliações em memória.
+    if(similarTable && !loaded && !background && memoryLimit == 0){
+        timePhase(&db.phases, "tabela de similares", [&]{ db.similar.build(db.players, db.userRatings, nThreads); return db.userRatings.ratingCount(); });
     }
 
-    // result inicia sendo povoado com o vector na posição 0 do vetor de vetores.
-    vector<int> result = vectors[0];
-
-    // Iterativamente chama a função para a interseção de dois vectors.
-    for (size_t i = 1; i < vectors.size(); ++i) {
-        result = intersectTwoVectors(result, vectors[i]);
+    // Avaliações recebidas depois da carga original (na carga progressiva, vêm depois dela).
+    if(!ratingLogPath.empty() && !background){
+        cout << "Processando " << ratingLogPath << "... ";
+        timePhase(&db.phases, ratingLogPath, [&]{ return openRatingLog(db, ratingLogPath); });
+        cout << "Pronto." << endl;
     }
 
-    return result;
-}
-
-int main(){
-    int M = 37879;
-    int N = 276989; 
-
-    // Hash tables
-    HashTable<Player>   players(M);
-    HashTable<User>     users(N);
-
-    // Tries
-    Trie playerNames;
-    Trie playerTags;
+    // Índices de trigramas dos nomes e de filtros do top (não vão para o snapshot: são
+    // refeitos a partir dos jogadores).
+    timePhase(&db.phases, "indice de trigramas", [&]{ db.nameIndex.build(db.players); return db.players.size(); });
+    timePhase(&db.phases, "indice de filtros", [&]{ db.filterIndex.build(db.players); return db.players.size(); });
 
-    // Pointers
-    Player* playerPtr = nullptr;
-    User* userPtr = nullptr;
-
-    // Instances
-    Player  oPlayer;
-    User    oUser;
-
-    // Input
-    string input, query_type, query_args;
-    bool quit = false;
-
-    // Vectors
-    vector<int> player_id_list;
-    vector<Player> player_list;
-    vector<Rating> rating_list;
-    vector<string> tag_list;
-
-    auto start = chrono::high_resolution_clock::now();
-
-    buildHash(players, users, PLAYERS_DIR, RATING_DIR);
-    buildPlayerTrie(players, playerNames);
-    buildTagsTrie(TAGS_DIR, playerTags);
+    // Ranking por prefixo e índice por posição, derivados das notas.
+    timePhase(&db.phases, "rankings", [&]{ buildRankings(db); return (size_t) 0; });
 
     auto end = chrono::high_resolution_clock::now();
     chrono::duration<double> duration = end - start;
 
     cout << "Processo finalizado em "<< duration.count() << " segundos.\n" << endl;
 
-    /*int total_users = 0;
-    for(int i = 0; i < users.table.size(); i++){
-        if(!users.table[i].empty()){
-            for(int j = 0; j < users.table[i].size(); j++){
-                total_users++;
+    if(!saveSnapshotPath.empty()){
+        cout << "Gravando snapshot " << saveSnapshotPath << "... ";
+        // O snapshot grava a tabela de similares já com as avaliações do log; sem --similar,
+        // ela é calculada aqui.
+        bool updated = db.userRatings.updateCount() > 0;
+        db.userRatings.mergeUpdates();
+        if((updated || db.similar.empty()) && memoryLimit == 0){
+            timePhase(&db.phases, "tabela de similares", [&]{ db.similar.build(db.players, db.userRatings, nThreads); return db.userRatings.ratingCount(); });
+        }
+        cout << (saveSnapshot(saveSnapshotPath, db.players, db.users, db.userRatings, db.playerNames, db.tagIndex, db.similar) ? "Pronto." : "Falha na gravacao.") << "\n" << endl;
+    }
+
+    cout.rdbuf(coutBuffer);
+
+    atomic<bool> stopFollow(false);
+    thread follower;
+    if(!followPath.empty()) follower = thread(followRatings, std::ref(db), followPath, std::cref(stopFollow));
+    auto stopFollower = [&]{
+        stopFollow = true;
+        if(follower.joinable()) follower.join();
+    };
+
+    // Modo batch
+    if(!batchPath.empty()){
+        ifstream batchFile;
+        if(batchPath != "-"){
+            batchFile.open(batchPath);
+            if(!batchFile){
+                cerr << "Arquivo de pesquisas " << batchPath << " nao encontrado." << endl;
+                stopFollower();
+                return 1;
             }
         }
-    }*/
-
-    //cout << "NUM OF USERS: " << total_users << endl; //~138k
-
-    // Menu
-    while(!quit){
-        cout << "Digite a pesquisa desejada: ";
-        getline(cin, input);
-        istringstream iss(input);
-        iss >> query_type;
-        query_type = toLowerCase(query_type);
 
-        // Pesq 1: Player <sofifa_id>
-        if(query_type == "player"){
-            iss >> query_args;
-            query_args = toLowerCase(query_args);
-
-            playerNames.startsWith(query_args, player_id_list);
-            for(auto j : player_id_list){
-                hashSearch(players, j, playerPtr);
-                oPlayer = *playerPtr;
-                player_list.push_back(oPlayer);
-            }
-
-            // Sorts by global rating
-            mergeSort(player_list, 0, (player_list.size()-1));
-            
-            cout << endl;
-            for(auto k : player_list){    
-                cout    << setw(ID_FIELD_WIDTH)     << k.id << " " 
-                        << setw(SHORT_FIELD_WIDTH)  << k.short_name << " " 
-                        << setw(LONG_FIELD_WIDTH)   << k.long_name << " " 
-                        << setw(POS_FIELD_WIDTH)    << k.player_positions << " "
-                        << setw(RATING_FIELD_WIDTH) << fixed << setprecision(6) << k.rating
-                        << setw(COUNT_FIELD_WIDTH)  << k.total_ratings 
-                        << endl;
-            }
-        }
-
-        // Pesq 2: User <user_id>
-        else if(query_type == "user"){
-            iss >> query_args;
-            query_args = toLowerCase(query_args);
-            int key = stoi(query_args);
-
-            hashSearch(users, key, userPtr);
-            oUser = *userPtr;
-            rating_list = oUser.user_ratings;
-
-            for(const auto r : rating_list){
-                hashSearch(players, r.id, playerPtr);
-                oPlayer = *playerPtr;
-                player_list.push_back(oPlayer);
-            }
-
-            // Ordenação secundária: global rating
-            mergeSort(player_list, 0, (player_list.size()-1));
-
-            // Atualiza rating_list de acordo com os ids de player_list.
-            updateVectorById(player_list, rating_list);
-
-            // Ordenação primária: user rating
-            mergeSort(rating_list, 0, (rating_list.size()-1));
-
-            // Atualiza player_list de acordo com os ids de rating_list.
-            updateVectorById(rating_list, player_list);
-
-            cout << endl;
-            for(int i = 0; i < 20; i++){
-                cout    << setw(ID_FIELD_WIDTH)     << rating_list[i].id << " " 
-                        << setw(SHORT_FIELD_WIDTH)  << player_list[i].short_name << " "
-                        << setw(LONG_FIELD_WIDTH)   << player_list[i].long_name << " "
-                        << setw(RATING_FIELD_WIDTH) << fixed << setprecision(6) << player_list[i].rating << " "
-                        << setw(COUNT_FIELD_WIDTH)  << player_list[i].total_ratings << " "
-                        << setw(RATING_FIELD_WIDTH) << fixed << setprecision(1) << rating_list[i].rating << " " 
-                        << endl;
-            }
-        }
-
-        // Pesq 3: Top <N> <position>
-        else if(query_type == "top"){
-            int N;
-            string position;
-
-            // Atribui o segundo e terceiro membros da stream à var N e posição, respectivamente.
-            iss >> N >> position;
-
-            // Como as posições estão armazenadas em letras maiusculas, 
-            // normaliza o input do usuário para letras maiusculas.
-            position = toUpperCase(position);
-
-            for(int i = 0; i < players.table.size(); i++){
-                for(const auto player : players.table[i]){
-                    // Corre pelo hash de jogadores, adicionando ao vector apenas aqueles que
-                    // contêm a substring da posição desejada e que possuem 1000 ou mais avaliações.
-                    if(player.total_ratings >= 1000 && (containsSubstring(player.player_positions, position))){
-                        oPlayer = player;
-                        player_list.push_back(oPlayer);
-                    }
-                }
-            }
-
-            mergeSort(player_list, 0, (player_list.size()-1));
-            
-            cout << endl;
-            for(int i = 0; i < N; i++){
-                cout    << setw(ID_FIELD_WIDTH) << player_list[i].id << " "
-                        << setw(SHORT_FIELD_WIDTH) << player_list[i].short_name << " "
-                        << setw(LONG_FIELD_WIDTH) << player_list[i].long_name << " "
-                        << setw(POS_FIELD_WIDTH) << player_list[i].player_positions << " "
-                        << setw(NATION_FIELD_WIDTH) << player_list[i].nationality << " "
-                        << setw(CLUB_FIELD_WIDTH) << player_list[i].club_name << " "
-                        << setw(LEAGUE_FIELD_WIDTH) << player_list[i].league_name << " "
-                        << setw(RATING_FIELD_WIDTH) << fixed << setprecision(6) << player_list[i].rating << " "
-                        << setw(COUNT_FIELD_WIDTH) << player_list[i].total_ratings << " "
-                        << endl;
-            }
-        }
-
-        // Pesq 4: tags <list of tags>
-        else if(query_type ==  "tags"){
-            // Realiza o parsing do restante da linha escrita pelo usuário.
-            // tags são retornadas no vector tag_list.
-            tag_list = parseTags(iss);
-            vector<vector<int>> tag_results;
-
-            for(int i = 0; i < tag_list.size(); i++){
-                // Busca tag na trie, adiciona os ids (int) relacionados à tag 
-                // ao vector player_id_list e posteriormente adiciona ao vector tag_results.
-                playerTags.search(tag_list[i], player_id_list);
-                tag_results.push_back(player_id_list);
-                player_id_list.clear();
-            }
-            
-            // Cria o vetor intersection e realiza a interseção de todos os vectors em tag_results.
-            vector<int> intersection = intersectMultipleVectors(tag_results);
-
-            // Para cada id na interseção, busca o player correspondente no Hash 'players'.
-            for(const auto i : intersection){
-                hashSearch(players, i, playerPtr);
-                oPlayer = *playerPtr;
-                player_list.push_back(oPlayer);
-            }
+        BatchReport report = runBatch(db, (batchPath == "-") ? cin : batchFile, nThreads, cout, format);
+        printBatchReport(report, cerr);
+        stopFollower();
+        return 0;
+    }
 
-            // Ordena a player_list com base na nota global.
-            mergeSort(player_list, 0, (player_list.size()-1));
+    // Modo servidor
+    if(!serveAddress.empty()){
+        signal(SIGINT, onStopSignal);
+        signal(SIGTERM, onStopSignal);
 
-            cout << endl;
-            for(int i = 0; i < player_list.size(); i++){
-                cout    << setw(ID_FIELD_WIDTH) << player_list[i].id << " "
-                        << setw(SHORT_FIELD_WIDTH) << player_list[i].short_name << " "
-                        << setw(LONG_FIELD_WIDTH) << player_list[i].long_name << " "
-                        << setw(POS_FIELD_WIDTH) << player_list[i].player_positions << " "
-                        << setw(NATION_FIELD_WIDTH) << player_list[i].nationality << " "
-                        << setw(CLUB_FIELD_WIDTH) << player_list[i].club_name << " "
-                        << setw(LEAGUE_FIELD_WIDTH) << player_list[i].league_name << " "
-                        << setw(RATING_FIELD_WIDTH) << fixed << setprecision(6) << player_list[i].rating << " "
-                        << setw(COUNT_FIELD_WIDTH) << player_list[i].total_ratings << " "
-                        << endl;
-            }
-        }
+        QueryServer server(db, serverStop);
+        cout << "Atendendo em " << serveAddress << "." << endl;
+        bool ok = server.run(serveAddress);
+        if(!ok) cerr << "Endereco " << serveAddress << " indisponivel." << endl;
+        stopFollower();
+        return ok ? 0 : 1;
+    }
 
-        // Sair
-        else if(query_type == "sair") quit = true;
+    //cout << "NUM OF USERS: " << users.count << endl; //~138k
 
-        // Default: comando desconhecido
-        else{
-            cout << "Comando desconhecido.";
-        }
-        cout << endl;
+    thread loader;
+    if(background) loader = thread(loadRatingsInBackground, std::ref(db), RATING_DIR, nThreads, ratingLogPath, similarTable);
 
-        // Clear buffers
-        player_id_list.clear();
-        player_list.clear();
-        rating_list.clear();
-        tag_list.clear();
-    }
+    // Menu
+    QueryScratch scratch;
+    scratch.format = format;
+    string input;
+    while(true){
+        cout << "Digite a pesquisa desejada";
+        if(db.loadStage < LOAD_COMPLETE) cout << " (avaliacoes: " << loadPercent(db) << "%)";
+        cout << ": ";
+        if(!getline(cin, input)) break;
+        if(runCommand(db, input, scratch, cout) == QUERY_QUIT) break;
+    }
+    if(loader.joinable()){
+        if(db.loadStage < LOAD_COMPLETE) cout << "Aguardando o fim da carga das avaliacoes..." << endl;
+        loader.join();
+    }
+    stopFollower();
 
     return 0;
 }
\ No newline at end of file
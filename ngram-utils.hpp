@@ -0,0 +1,129 @@
+// ngram-utils.hpp
+// trshpnd 2024
+//
+// Índice invertido de trigramas dos nomes (short_name e long_name), para a pesquisa por
+// substring 'contains'. Cada trigrama (3 bytes do nome em minúsculas) tem a PostingList
+// comprimida com os índices dos jogadores em que aparece. Uma pesquisa intersecta as
+// listas dos trigramas do texto procurado e confirma cada candidato no nome, já que ter
+// todos os trigramas não garante que eles estejam em sequência. O índice não muda depois
+// de montado, então as cópias o compartilham.
+
+#pragma once
+
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "posting-utils.hpp"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+#define NGRAM_SIZE 3
+
+// Trigrama como inteiro de 24 bits.
+inline uint32_t trigramKey(const char* p) {
+    return ((uint32_t) (unsigned char) p[0] << 16) | ((uint32_t) (unsigned char) p[1] << 8) | (unsigned char) p[2];
+}
+
+class NameIndex {
+private:
+    struct Data {
+        vector<uint32_t> keys;              // Trigramas, em ordem crescente.
+        vector<PostingList> postings;       // Lista de cada trigrama (índices de jogador).
+        string folded;                      // "short\nlong" em minúsculas de cada jogador, para a confirmação.
+        vector<uint32_t> foldedOffsets{0};  // Início de cada jogador em 'folded' (+1 sentinela).
+    };
+    shared_ptr<const Data> data = make_shared<const Data>();
+
+    // Lista do trigrama, ou nullptr se ele não aparece em nenhum nome.
+    const PostingList* find(uint32_t key) const {
+        auto it = lower_bound(data->keys.begin(), data->keys.end(), key);
+        if (it == data->keys.end() || *it != key) return nullptr;
+        return &data->postings[it - data->keys.begin()];
+    }
+
+public:
+    // Monta o índice com os nomes de todos os jogadores.
+    void build(const PlayerStore& players) {
+        auto built = make_shared<Data>();
+        vector<uint32_t>& keys = built->keys;
+        vector<PostingList>& postings = built->postings;
+        string& folded = built->folded;
+        vector<uint32_t>& foldedOffsets = built->foldedOffsets;
+
+        // Pares (trigrama, jogador): ordenados, agrupam as listas já em ordem de jogador.
+        vector<uint64_t> pairs;
+        for (size_t index = 0; index < players.size(); index++) {
+            size_t start = folded.size();
+            folded += toLowerCase(players.text(index, SHORT_NAME));
+            folded += '\n';
+            folded += toLowerCase(players.text(index, LONG_NAME));
+            foldedOffsets.push_back(folded.size());
+
+            // O '\n' separa os nomes: trigramas que passam por ele não são indexados.
+            for (size_t i = start; i + NGRAM_SIZE <= folded.size(); i++) {
+                if (memchr(folded.data() + i, '\n', NGRAM_SIZE)) continue;
+                pairs.push_back(((uint64_t) trigramKey(folded.data() + i) << 32) | index);
+            }
+        }
+        sort(pairs.begin(), pairs.end());
+        pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+
+        vector<int> ids;
+        for (size_t i = 0; i < pairs.size();) {
+            uint32_t key = pairs[i] >> 32;
+            ids.clear();
+            for (; i < pairs.size() && (uint32_t) (pairs[i] >> 32) == key; i++) ids.push_back((uint32_t) pairs[i]);
+            keys.push_back(key);
+            postings.emplace_back(ids);
+        }
+        data = std::move(built);
+    }
+
+    // true se o nome do jogador contém 'text' (já em minúsculas).
+    bool matches(int index, string_view text) const {
+        const vector<uint32_t>& offsets = data->foldedOffsets;
+        string_view names = string_view(data->folded).substr(offsets[index], offsets[index + 1] - offsets[index]);
+        return names.find(text) != string_view::npos;
+    }
+
+    // Índices dos jogadores cujo short_name ou long_name contém 'text' (em minúsculas), em
+    // ordem crescente. Textos menores que um trigrama percorrem todos os nomes.
+    void search(string_view text, IntersectScratch& scratch, vector<int>& result) const {
+        result.clear();
+        if (text.empty() || text.find('\n') != string_view::npos) return;
+
+        if (text.size() < NGRAM_SIZE) {
+            for (size_t index = 0; index + 1 < data->foldedOffsets.size(); index++) {
+                if (matches(index, text)) result.push_back(index);
+            }
+            return;
+        }
+
+        scratch.lists.clear();
+        for (size_t i = 0; i + NGRAM_SIZE <= text.size(); i++) {
+            const PostingList* list = find(trigramKey(text.data() + i));
+            if (!list) return;
+            if (std::find(scratch.lists.begin(), scratch.lists.end(), list) == scratch.lists.end()) scratch.lists.push_back(list);
+        }
+        intersectPostings(scratch, result);
+
+        // Um trigrama só já é o texto todo; com mais de um, confirma a sequência.
+        if (text.size() == NGRAM_SIZE) return;
+        result.erase(remove_if(result.begin(), result.end(), [&](int index) { return !matches(index, text); }), result.end());
+    }
+
+    size_t trigramCount() const { return data->keys.size(); }
+
+    size_t memoryBytes() const {
+        size_t bytes = data->keys.capacity() * sizeof(uint32_t) + data->folded.capacity() + data->foldedOffsets.capacity() * sizeof(uint32_t);
+        for (const auto& list : data->postings) bytes += sizeof(PostingList) + list.memoryBytes();
+        return bytes;
+    }
+};
@@ -0,0 +1,171 @@
+// player-utils.hpp
+// trshpnd 2024
+//
+// Jogadores em formato colunar. Cada jogador recebe um índice denso na ordem de inserção;
+// id, nota e total de avaliações ficam em vetores separados indexados por ele. Nomes e
+// posições ficam todos em uma única string (arena), expostos como string_view. As colunas
+// categóricas (nacionalidade, clube e liga), com poucas centenas de valores distintos,
+// guardam um código por jogador; o texto fica uma vez só no dicionário da coluna.
+// Ordenações e varreduras lêem só as colunas numéricas e de códigos; o texto é acessado
+// na impressão.
+// A soma das notas fica guardada ao lado da média para que uma avaliação nova (comando
+// 'rate') atualize a média em O(1).
+
+#pragma once
+
+#include "hash-utils.hpp"
+#include "dictionary-utils.hpp"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+
+// Campos de texto, na ordem das colunas do players.csv.
+enum PlayerField {
+    SHORT_NAME,
+    LONG_NAME,
+    PLAYER_POSITIONS,
+    NATIONALITY,
+    CLUB_NAME,
+    LEAGUE_NAME,
+    PLAYER_TEXT_FIELDS
+};
+
+// Campos guardados na arena; os seguintes (a partir de NATIONALITY) são categóricos.
+#define PLAYER_FREE_FIELDS      3
+#define PLAYER_CATEGORY_FIELDS  (PLAYER_TEXT_FIELDS - PLAYER_FREE_FIELDS)
+
+// Todos os campos de um jogador, montados para a impressão.
+struct PlayerView{
+    int id;
+    string_view short_name;
+    string_view long_name;
+    string_view player_positions;
+    string_view nationality;
+    string_view club_name;
+    string_view league_name;
+    int total_ratings;
+    float rating;
+};
+
+// Entrada da tabela sofifa_id -> índice denso.
+struct PlayerSlot{
+    int id;
+    int index;
+};
+
+class PlayerStore {
+private:
+    vector<int> ids;
+    vector<float> ratings;          // Soma das notas durante a carga; média depois dela.
+    vector<int> totals;
+    vector<double> sums;            // Soma das notas, definida ao fim da carga (setRatingSum).
+    vector<uint32_t> textOffsets;   // Campo f do jogador i: arena[textOffsets[i*3+f], textOffsets[i*3+f+1]).
+    string arena;
+    vector<uint32_t> codes[PLAYER_CATEGORY_FIELDS];     // Código de cada jogador, por coluna categórica.
+    StringDictionary categories[PLAYER_CATEGORY_FIELDS];
+    HashTable<PlayerSlot> byId;
+
+public:
+    PlayerStore(size_t expected = 16) : byId(expected) {
+        ids.reserve(expected);
+        ratings.reserve(expected);
+        totals.reserve(expected);
+        sums.reserve(expected);
+        textOffsets.reserve(expected * PLAYER_FREE_FIELDS + 1);
+        for(auto &column : codes) column.reserve(expected);
+        textOffsets.push_back(0);
+    }
+
+    // Adiciona um jogador e retorna seu índice. Um id repetido mantém o primeiro cadastro.
+    // 'rating' é a média; a soma é reconstruída dela (as notas são múltiplos de 0.5).
+    int add(int id, const string_view text[PLAYER_TEXT_FIELDS], int total_ratings = 0, float rating = 0){
+        int existing = find(id);
+        if(existing >= 0) return existing;
+
+        int index = ids.size();
+        ids.push_back(id);
+        ratings.push_back(rating);
+        totals.push_back(total_ratings);
+        sums.push_back(round((double) rating * total_ratings * 2) / 2);
+        for(int f = 0; f < PLAYER_FREE_FIELDS; f++){
+            arena.append(text[f]);
+            textOffsets.push_back(arena.size());
+        }
+        for(int c = 0; c < PLAYER_CATEGORY_FIELDS; c++){
+            codes[c].push_back(categories[c].insert(text[PLAYER_FREE_FIELDS + c]));
+        }
+        hashInsert(byId, PlayerSlot{id, index});
+        return index;
+    }
+
+    // Índice denso do jogador, ou -1 se o id não existir.
+    int find(int id) const{
+        const PlayerSlot* slot = nullptr;
+        hashSearch(byId, id, slot);
+        return slot ? slot->index : -1;
+    }
+
+    size_t size() const{ return ids.size(); }
+
+    int id(int index) const{ return ids[index]; }
+    float rating(int index) const{ return ratings[index]; }
+    int totalRatings(int index) const{ return totals[index]; }
+
+    void setRating(int index, float rating){ ratings[index] = rating; }
+    void setTotalRatings(int index, int total){ totals[index] = total; }
+
+    // Define a soma das notas e recalcula a média.
+    void setRatingSum(int index, double sum){
+        sums[index] = sum;
+        ratings[index] = totals[index] ? (float) (sum / totals[index]) : 0;
+    }
+
+    // Avaliação nova (countDelta = 1) ou troca de nota (countDelta = 0), em O(1).
+    void addRating(int index, double delta, int countDelta){
+        totals[index] += countDelta;
+        setRatingSum(index, sums[index] + delta);
+    }
+
+    string_view text(int index, PlayerField field) const{
+        if(field >= PLAYER_FREE_FIELDS) return categories[field - PLAYER_FREE_FIELDS].value(code(index, field));
+        size_t f = (size_t) index * PLAYER_FREE_FIELDS + field;
+        return string_view(arena).substr(textOffsets[f], textOffsets[f + 1] - textOffsets[f]);
+    }
+
+    // Colunas categóricas (NATIONALITY, CLUB_NAME, LEAGUE_NAME): código do jogador, a coluna
+    // inteira de códigos e o dicionário código -> texto.
+    uint32_t code(int index, PlayerField field) const{ return codes[field - PLAYER_FREE_FIELDS][index]; }
+    const vector<uint32_t>& codeColumn(PlayerField field) const{ return codes[field - PLAYER_FREE_FIELDS]; }
+    const StringDictionary& category(PlayerField field) const{ return categories[field - PLAYER_FREE_FIELDS]; }
+
+    PlayerView view(int index) const{
+        return {ids[index], text(index, SHORT_NAME), text(index, LONG_NAME), text(index, PLAYER_POSITIONS),
+                text(index, NATIONALITY), text(index, CLUB_NAME), text(index, LEAGUE_NAME), totals[index], ratings[index]};
+    }
+
+    const HashTable<PlayerSlot>& idTable() const{ return byId; }
+
+    // Colunas, arena e dicionários (a tabela de ids é contada à parte, via hashStats).
+    size_t memoryBytes() const{
+        size_t bytes = ids.capacity() * sizeof(int) + ratings.capacity() * sizeof(float) + totals.capacity() * sizeof(int) + sums.capacity() * sizeof(double)
+                     + textOffsets.capacity() * sizeof(uint32_t) + arena.capacity();
+        for(int c = 0; c < PLAYER_CATEGORY_FIELDS; c++) bytes += codes[c].capacity() * sizeof(uint32_t) + categories[c].memoryBytes();
+        return bytes;
+    }
+};
+
+struct Rating{
+    int id;
+    float rating;
+};
+
+// As avaliações ficam no RatingStore; 'index' é a posição densa do usuário nele.
+struct User{
+    int id;
+    int index;
+};
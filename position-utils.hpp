@@ -0,0 +1,101 @@
+// position-utils.hpp
+// trshpnd 2024
+//
+// Índice secundário por posição de jogo. As posições de cada jogador ("RW, ST, CF") são
+// convertidas em um conjunto de bits e, para cada posição, é mantida a lista dos jogadores
+// elegíveis ao 'top' (TOP_MIN_RATINGS avaliações ou mais), já ordenada pelo ranking.
+
+#pragma once
+
+#include "player-utils.hpp"
+
+#include <algorithm>
+#include <string_view>
+#include <cstdint>
+
+using namespace std;
+
+#define POSITION_COUNT      15
+#define TOP_MIN_RATINGS     1000
+
+const char* POSITION_NAMES[POSITION_COUNT] = {
+    "GK", "CB", "LB", "RB", "LWB", "RWB", "CDM", "CM", "CAM", "LM", "RM", "LW", "RW", "CF", "ST"
+};
+
+// Código da posição (índice em POSITION_NAMES), ou -1 se desconhecida. Comparação exata.
+int positionCode(string_view name){
+    for(int i = 0; i < POSITION_COUNT; i++){
+        if(name == POSITION_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+// Converte o campo player_positions em um conjunto de bits (bit i = POSITION_NAMES[i]).
+uint16_t parsePositions(string_view field){
+    uint16_t mask = 0;
+    size_t i = 0;
+
+    while(i < field.size()){
+        while(i < field.size() && (field[i] == ',' || field[i] == ' ')) i++;
+        size_t start = i;
+        while(i < field.size() && field[i] != ',' && field[i] != ' ') i++;
+
+        int code = positionCode(field.substr(start, i - start));
+        if(code >= 0) mask |= 1u << code;
+    }
+    return mask;
+}
+
+inline bool topEligible(const PlayerStore &players, int index){
+    return players.totalRatings(index) >= TOP_MIN_RATINGS;
+}
+
+class PositionIndex {
+private:
+    vector<int> lists[POSITION_COUNT];  // sofifa_ids, do melhor para o pior.
+
+public:
+    // Monta as listas a partir dos jogadores. 'better(a, b)' define o ranking.
+    template <typename Better>
+    void build(const PlayerStore &players, Better better){
+        for(auto &list : lists) list.clear();
+
+        for(int index = 0; index < (int) players.size(); index++){
+            if(!topEligible(players, index)) continue;
+            uint16_t mask = parsePositions(players.text(index, PLAYER_POSITIONS));
+            for(int code = 0; code < POSITION_COUNT; code++){
+                if(mask & (1u << code)) lists[code].push_back(players.id(index));
+            }
+        }
+
+        for(auto &list : lists) sort(list.begin(), list.end(), better);
+    }
+
+    // Reposiciona o jogador nas listas das suas posições depois que a média ou o total de
+    // avaliações mudou. Deve ser chamado com os novos valores já gravados no PlayerStore.
+    template <typename Better>
+    void update(const PlayerStore &players, int index, Better better){
+        int id = players.id(index);
+        uint16_t mask = parsePositions(players.text(index, PLAYER_POSITIONS));
+
+        for(int code = 0; code < POSITION_COUNT; code++){
+            if(!(mask & (1u << code))) continue;
+            vector<int> &list = lists[code];
+
+            auto current = find(list.begin(), list.end(), id);
+            if(current != list.end()) list.erase(current);
+
+            if(topEligible(players, index)){
+                list.insert(upper_bound(list.begin(), list.end(), id, better), id);
+            }
+        }
+    }
+
+    const vector<int>& players(int code) const { return lists[code]; }
+
+    size_t memoryBytes() const{
+        size_t bytes = 0;
+        for(const auto &list : lists) bytes += list.capacity() * sizeof(int);
+        return bytes;
+    }
+};
@@ -0,0 +1,230 @@
+// posting-utils.hpp
+// trshpnd 2024
+//
+// Listas de ids (posting lists) ordenadas e comprimidas, e interseção de várias listas.
+// Os ids são agrupados em blocos de até POSTING_BLOCK. De cada bloco guarda-se o primeiro
+// id (tabela de saltos, sem compressão) e as diferenças entre ids consecutivos em varint.
+// A interseção percorre a menor lista e avança as demais com busca galopante sobre a
+// tabela de saltos, decodificando apenas os blocos que podem conter o id procurado.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define POSTING_BLOCK 128
+
+class PostingList {
+private:
+    vector<int> blockFirst;         // Primeiro id de cada bloco.
+    vector<uint32_t> blockOffset;   // Início de cada bloco em 'bytes' (+1 sentinela).
+    vector<uint8_t> bytes;          // Diferenças em varint (7 bits por byte).
+    size_t count = 0;
+
+public:
+    PostingList() = default;
+
+    // 'ids' deve estar ordenado e sem repetições.
+    explicit PostingList(const vector<int>& ids) {
+        count = ids.size();
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (i % POSTING_BLOCK == 0) {
+                blockFirst.push_back(ids[i]);
+                blockOffset.push_back(bytes.size());
+                continue;
+            }
+            uint32_t delta = ids[i] - ids[i - 1];
+            while (delta >= 0x80) {
+                bytes.push_back((delta & 0x7F) | 0x80);
+                delta >>= 7;
+            }
+            bytes.push_back(delta);
+        }
+        blockOffset.push_back(bytes.size());
+    }
+
+    size_t size() const { return count; }
+    size_t blocks() const { return blockFirst.size(); }
+    int firstOf(size_t block) const { return blockFirst[block]; }
+    size_t memoryBytes() const { return blockFirst.size() * sizeof(int) + blockOffset.size() * sizeof(uint32_t) + bytes.size(); }
+
+    // Decodifica o bloco em 'out' (espaço para POSTING_BLOCK ids). Retorna quantos ids há nele.
+    size_t decodeBlock(size_t block, int* out) const {
+        const uint8_t* p = bytes.data() + blockOffset[block];
+        const uint8_t* end = bytes.data() + blockOffset[block + 1];
+        size_t n = 1;
+
+        out[0] = blockFirst[block];
+        while (p < end) {
+            uint32_t delta = 0;
+            int shift = 0;
+            while (*p & 0x80) {
+                delta |= (uint32_t) (*p++ & 0x7F) << shift;
+                shift += 7;
+            }
+            delta |= (uint32_t) (*p++) << shift;
+            out[n] = out[n - 1] + delta;
+            n++;
+        }
+        return n;
+    }
+
+    void decodeAll(vector<int>& out) const {
+        int buffer[POSTING_BLOCK];
+        for (size_t b = 0; b < blocks(); b++) {
+            size_t n = decodeBlock(b, buffer);
+            out.insert(out.end(), buffer, buffer + n);
+        }
+    }
+
+    // Serialização para o snapshot: contagens seguidas dos três vetores.
+    void serialize(string& out) const {
+        uint32_t header[3] = {(uint32_t) count, (uint32_t) blockFirst.size(), (uint32_t) bytes.size()};
+        out.append((const char*) header, sizeof(header));
+        out.append((const char*) blockFirst.data(), blockFirst.size() * sizeof(int));
+        out.append((const char*) blockOffset.data(), blockOffset.size() * sizeof(uint32_t));
+        out.append((const char*) bytes.data(), bytes.size());
+    }
+
+    const char* deserialize(const char* in) {
+        uint32_t header[3];
+        memcpy(header, in, sizeof(header));
+        in += sizeof(header);
+
+        count = header[0];
+        blockFirst.resize(header[1]);
+        blockOffset.resize(header[1] + 1);
+        bytes.resize(header[2]);
+
+        memcpy(blockFirst.data(), in, blockFirst.size() * sizeof(int));
+        in += blockFirst.size() * sizeof(int);
+        memcpy(blockOffset.data(), in, blockOffset.size() * sizeof(uint32_t));
+        in += blockOffset.size() * sizeof(uint32_t);
+        memcpy(bytes.data(), in, bytes.size());
+        return in + bytes.size();
+    }
+};
+
+// Quantos elementos de values[from, n) são menores que 'target' (values ordenado).
+inline size_t countBelow(const int* values, size_t from, size_t n, int target) {
+    size_t i = from;
+#ifdef __SSE2__
+    const __m128i vTarget = _mm_set1_epi32(target);
+    while (i + 4 <= n) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (values + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(chunk, vTarget)));
+        if (mask != 0xF) return i + __builtin_popcount(mask) - from;
+        i += 4;
+    }
+#endif
+    while (i < n && values[i] < target) i++;
+    return i - from;
+}
+
+// Leitura sequencial de uma PostingList com avanço rápido (seek).
+class PostingCursor {
+private:
+    const PostingList* list = nullptr;
+    size_t block = 0;
+    size_t pos = 0;
+    size_t loaded = 0;
+    int buffer[POSTING_BLOCK];
+
+    void load(size_t b) {
+        block = b;
+        pos = 0;
+        loaded = (b < list->blocks()) ? list->decodeBlock(b, buffer) : 0;
+    }
+
+public:
+    void reset(const PostingList* postings) {
+        list = postings;
+        load(0);
+    }
+
+    bool atEnd() const { return pos >= loaded; }
+    int value() const { return buffer[pos]; }
+
+    void next() {
+        if (++pos >= loaded && block + 1 < list->blocks()) load(block + 1);
+    }
+
+    // Avança até o primeiro id >= target. Retorna false se a lista acabou.
+    bool seek(int target) {
+        if (atEnd()) return false;
+        if (buffer[loaded - 1] < target) {
+            // Busca galopante pelo último bloco cujo primeiro id é <= target.
+            size_t low = block + 1, step = 1, high = low;
+            while (high < list->blocks() && list->firstOf(high) <= target) {
+                low = high;
+                high += step;
+                step *= 2;
+            }
+            high = min(high, list->blocks());
+            while (low + 1 < high) {
+                size_t mid = (low + high) / 2;
+                if (list->firstOf(mid) <= target) low = mid;
+                else high = mid;
+            }
+            if (low >= list->blocks()) {
+                pos = loaded;
+                return false;
+            }
+            load(low);
+        }
+        pos += countBelow(buffer, pos, loaded, target);
+        if (pos >= loaded) next();
+        return !atEnd();
+    }
+};
+
+// Estado reutilizável entre consultas, para que a interseção não aloque memória
+// depois da primeira execução.
+struct IntersectScratch {
+    vector<const PostingList*> lists;
+    vector<PostingCursor> cursors;
+};
+
+// Interseção das listas em scratch.lists. O resultado (ordenado) vai para 'result'.
+// As listas são ordenadas por cardinalidade: a menor guia e as demais avançam com seek.
+void intersectPostings(IntersectScratch& scratch, vector<int>& result) {
+    vector<const PostingList*>& lists = scratch.lists;
+    result.clear();
+    if (lists.empty()) return;
+
+    sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) { return a->size() < b->size(); });
+    if (lists[0]->size() == 0) return;
+
+    scratch.cursors.resize(lists.size());
+    for (size_t i = 0; i < lists.size(); i++) scratch.cursors[i].reset(lists[i]);
+
+    PostingCursor& driver = scratch.cursors[0];
+    while (!driver.atEnd()) {
+        int candidate = driver.value();
+        bool inAll = true;
+
+        for (size_t i = 1; i < lists.size(); i++) {
+            PostingCursor& cursor = scratch.cursors[i];
+            if (!cursor.seek(candidate)) return;        // Uma das listas acabou.
+            if (cursor.value() != candidate) {
+                // O driver salta direto para o próximo id possível.
+                inAll = false;
+                if (!driver.seek(cursor.value())) return;
+                break;
+            }
+        }
+        if (inAll) {
+            result.push_back(candidate);
+            driver.next();
+        }
+    }
+}
@@ -0,0 +1,789 @@
+// query-utils.hpp
+// trshpnd 2024
+//
+// Estruturas carregadas (Database) e as pesquisas sobre elas. Cada pesquisa recebe a linha
+// digitada, escreve o resultado em um ostream e não altera a Database, então várias
+// pesquisas podem rodar ao mesmo tempo desde que cada uma use o seu QueryScratch.
+// As atualizações (comando 'rate', em update-utils.hpp) tomam a trava da Database em modo
+// exclusivo, e runCommand toma a trava em modo compartilhado antes de chamar runQuery.
+// No modo servidor as pesquisas rodam sobre cópias publicadas, sem trava.
+
+#pragma once
+
+#include "hash-utils.hpp"
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "position-utils.hpp"
+#include "tag-utils.hpp"
+#include "ngram-utils.hpp"
+#include "filter-utils.hpp"
+#include "similar-utils.hpp"
+#include "sort-utils.hpp"
+#include "csv-utils.hpp"
+#include "stats-utils.hpp"
+#include "render-utils.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <shared_mutex>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+
+using namespace std;
+
+#define ID_FIELD_WIDTH      6
+#define SHORT_FIELD_WIDTH   20
+#define LONG_FIELD_WIDTH    40
+#define POS_FIELD_WIDTH     15
+#define NATION_FIELD_WIDTH  15
+#define CLUB_FIELD_WIDTH    25
+#define LEAGUE_FIELD_WIDTH  30
+#define COUNT_FIELD_WIDTH   6
+#define RATING_FIELD_WIDTH  9
+
+#define USER_TOP_K          20  // Linhas exibidas por padrão na pesquisa 'user'.
+#define SIMILAR_DEFAULT_N   10  // Linhas exibidas por padrão na pesquisa 'similar'.
+
+// Colunas de cada resultado. No formato table reproduzem as larguras e os separadores do menu.
+const Column PLAYER_COLUMNS[] = {
+    {"sofifa_id", COLUMN_INT, ID_FIELD_WIDTH, 0, " "},
+    {"short_name", COLUMN_TEXT, SHORT_FIELD_WIDTH, 0, " "},
+    {"long_name", COLUMN_TEXT, LONG_FIELD_WIDTH, 0, " "},
+    {"player_positions", COLUMN_TEXT, POS_FIELD_WIDTH, 0, " "},
+    {"rating", COLUMN_FLOAT, RATING_FIELD_WIDTH, 6, ""},
+    {"total_ratings", COLUMN_INT, COUNT_FIELD_WIDTH, 0, ""}
+};
+
+const Column USER_COLUMNS[] = {
+    {"sofifa_id", COLUMN_INT, ID_FIELD_WIDTH, 0, " "},
+    {"short_name", COLUMN_TEXT, SHORT_FIELD_WIDTH, 0, " "},
+    {"long_name", COLUMN_TEXT, LONG_FIELD_WIDTH, 0, " "},
+    {"rating", COLUMN_FLOAT, RATING_FIELD_WIDTH, 6, " "},
+    {"total_ratings", COLUMN_INT, COUNT_FIELD_WIDTH, 0, " "},
+    {"user_rating", COLUMN_FLOAT, RATING_FIELD_WIDTH, 1, " "}
+};
+
+// Resultados de 'top' e 'tags'.
+const Column FULL_COLUMNS[] = {
+    {"sofifa_id", COLUMN_INT, ID_FIELD_WIDTH, 0, " "},
+    {"short_name", COLUMN_TEXT, SHORT_FIELD_WIDTH, 0, " "},
+    {"long_name", COLUMN_TEXT, LONG_FIELD_WIDTH, 0, " "},
+    {"player_positions", COLUMN_TEXT, POS_FIELD_WIDTH, 0, " "},
+    {"nationality", COLUMN_TEXT, NATION_FIELD_WIDTH, 0, " "},
+    {"club_name", COLUMN_TEXT, CLUB_FIELD_WIDTH, 0, " "},
+    {"league_name", COLUMN_TEXT, LEAGUE_FIELD_WIDTH, 0, " "},
+    {"rating", COLUMN_FLOAT, RATING_FIELD_WIDTH, 6, " "},
+    {"total_ratings", COLUMN_INT, COUNT_FIELD_WIDTH, 0, " "}
+};
+
+const Column SIMILAR_COLUMNS[] = {
+    {"sofifa_id", COLUMN_INT, ID_FIELD_WIDTH, 0, " "},
+    {"short_name", COLUMN_TEXT, SHORT_FIELD_WIDTH, 0, " "},
+    {"long_name", COLUMN_TEXT, LONG_FIELD_WIDTH, 0, " "},
+    {"player_positions", COLUMN_TEXT, POS_FIELD_WIDTH, 0, " "},
+    {"rating", COLUMN_FLOAT, RATING_FIELD_WIDTH, 6, " "},
+    {"total_ratings", COLUMN_INT, COUNT_FIELD_WIDTH, 0, " "},
+    {"common_users", COLUMN_INT, COUNT_FIELD_WIDTH, 0, " "},
+    {"similarity", COLUMN_FLOAT, RATING_FIELD_WIDTH, 4, " "}
+};
+
+#define COLUMN_COUNT(columns) ((int) (sizeof(columns) / sizeof(columns[0])))
+
+enum QueryType {
+    QUERY_PLAYER,
+    QUERY_USER,
+    QUERY_TOP,
+    QUERY_TAGS,
+    QUERY_CONTAINS,
+    QUERY_SIMILAR,
+    QUERY_RATE,
+    QUERY_STATS,
+    QUERY_QUIT,
+    QUERY_UNKNOWN,
+    QUERY_TYPES
+};
+
+// Etapas da carga progressiva (startup-utils.hpp), em ordem. Uma carga normal já começa
+// em LOAD_COMPLETE.
+enum LoadStage {
+    LOAD_PLAYERS,       // Jogadores, nomes e tags; ainda sem avaliações.
+    LOAD_TOTALS,        // Médias dos jogadores e rankings prontos.
+    LOAD_COMPLETE       // Avaliações de cada usuário prontas.
+};
+
+const char* QUERY_NAMES[QUERY_TYPES] = {"player", "user", "top", "tags", "contains", "similar", "rate", "stats", "sair", "desconhecido"};
+
+struct Database{
+    PlayerStore         players;
+    HashTable<User>     users;
+    RatingStore         userRatings;    // Avaliações dos usuários (CSR)
+    Trie                playerNames;
+    TagIndex            tagIndex;
+    PositionIndex       positionIndex;  // top N <position>
+    NameIndex           nameIndex;      // contains <texto>
+    FilterIndex         filterIndex;    // top N ... nation|club|league '<nome>'
+    SimilarityTable     similar;        // similar <sofifa_id> (co-ocorrência, gravada no snapshot)
+
+    // Instrumentação: fases da carga e latência das pesquisas por tipo. Os contadores são
+    // compartilhados entre a Database e as suas cópias.
+    vector<PhaseTiming> phases;
+    shared_ptr<QueryCounters[]> queryCounters;
+
+    // Atualizações ao vivo: trava leitores/escritor, log das avaliações aplicadas e número
+    // de avaliações aplicadas desde a carga.
+    mutable shared_mutex updateLock;
+    ofstream ratingLog;
+    atomic<uint64_t> updateVersion{0};
+
+    // Carga progressiva: etapa concluída e andamento da carga de avaliações (bytes).
+    atomic<int> loadStage{LOAD_COMPLETE};
+    atomic<size_t> loadDone{0};
+    atomic<size_t> loadTotal{0};
+    mutable mutex loadMutex;
+    mutable condition_variable loadChanged;
+
+    Database(size_t expectedPlayers = 16, size_t expectedUsers = 16)
+        : players(expectedPlayers), users(expectedUsers), queryCounters(new QueryCounters[QUERY_TYPES]) {}
+
+    // Cópia das estruturas, para publicação no modo servidor. A trava e o log não são
+    // copiados; deve ser feita com a trava da origem em modo compartilhado. As partes que
+    // não mudam depois da carga (CSR das avaliações, índices de tags, de trigramas e de
+    // filtros e tabela de similares) são compartilhadas; as que o 'rate' altera (jogadores,
+    // usuários, atualizações das avaliações, trie de nomes e índice por posição) são copiadas.
+    Database(const Database &other)
+        : players(other.players), users(other.users), userRatings(other.userRatings), playerNames(other.playerNames),
+          tagIndex(other.tagIndex), positionIndex(other.positionIndex), nameIndex(other.nameIndex), filterIndex(other.filterIndex), similar(other.similar),
+          phases(other.phases),
+          queryCounters(other.queryCounters), updateVersion(other.updateVersion.load()),
+          loadStage(other.loadStage.load()), loadDone(other.loadDone.load()), loadTotal(other.loadTotal.load()) {}
+};
+
+// Andamento da carga de avaliações, de 0 a 100.
+int loadPercent(const Database &db){
+    size_t total = db.loadTotal;
+    if(total == 0) return db.loadStage == LOAD_COMPLETE ? 100 : 0;
+    return (int) min<size_t>(100, db.loadDone * 100 / total);
+}
+
+// Conclui a etapa 'stage' da carga e acorda as pesquisas que a aguardam.
+void setLoadStage(Database &db, LoadStage stage){
+    lock_guard<mutex> guard(db.loadMutex);
+    db.loadStage = stage;
+    db.loadChanged.notify_all();
+}
+
+// Espera a carga chegar à etapa 'stage'. Não deve ser chamada com a trava da Database.
+void waitForStage(const Database &db, LoadStage stage){
+    if(db.loadStage >= stage) return;
+    unique_lock<mutex> guard(db.loadMutex);
+    db.loadChanged.wait(guard, [&]{ return db.loadStage >= stage; });
+}
+
+// Ordem dos rankings: maior nota global primeiro; empate pelo menor sofifa_id.
+struct RankByRating{
+    const PlayerStore* players;
+
+    bool operator()(int a, int b) const{
+        int indexA = players->find(a);
+        int indexB = players->find(b);
+
+        float ratingA = (indexA >= 0) ? players->rating(indexA) : 0;
+        float ratingB = (indexB >= 0) ? players->rating(indexB) : 0;
+        if(ratingA != ratingB) return ratingA > ratingB;
+        return a < b;
+    }
+};
+
+// Mesma ordem de RankByRating como chave inteira, para o radix sort das consultas.
+struct RankKey{
+    const PlayerStore* players;
+
+    uint64_t operator()(int id) const{
+        int index = players->find(id);
+        return rankKey((index >= 0) ? players->rating(index) : 0, id);
+    }
+};
+
+// Vetores de trabalho de uma pesquisa, reaproveitados entre pesquisas da mesma thread.
+struct QueryScratch{
+    vector<int> player_id_list;
+    vector<string> tag_list;
+    vector<Rating> ratings;     // Avaliações de um usuário com atualizações (RatingStore::current).
+    SortScratch sort;
+    IntersectScratch intersect;
+    string output;              // Saída da pesquisa, escrita de uma vez ao fim (ResultWriter).
+    OutputFormat format = FORMAT_TABLE;     // Formato padrão das pesquisas desta thread/sessão.
+};
+
+// Linha completa de um jogador (top e tags).
+void writeFullRow(ResultWriter &writer, const PlayerView &k){
+    writer.value(k.id);
+    writer.value(k.short_name);
+    writer.value(k.long_name);
+    writer.value(k.player_positions);
+    writer.value(k.nationality);
+    writer.value(k.club_name);
+    writer.value(k.league_name);
+    writer.value(k.rating);
+    writer.value(k.total_ratings);
+    writer.endRow();
+}
+
+vector<string> parseTags(istringstream &iss) {
+    vector<string> tags;
+    string line;
+    getline(iss, line);
+
+    bool inside = false;
+    string currentTag;
+
+    for (char ch : line) {
+        if (ch == '\'') {
+            if (inside) {
+                // Fim da tag, push.
+                tags.push_back(currentTag);
+                currentTag.clear();
+            }
+            // Alterna se dentro/fora das apóstrofes.
+            inside = !inside;
+        } else if (inside) {
+            // Adiciona o caracter à tag atual.
+            currentTag += ch;
+        }
+    }
+
+    return tags;
+}
+
+// Pesq 1: Player <prefix> [N [offset]]
+void queryPlayer(const Database &db, istringstream &iss, QueryScratch &scratch, RenderOptions options){
+    vector<int> &player_id_list = scratch.player_id_list;
+    string query_args;
+    int limit = -1;
+    int offset = 0;
+    iss >> query_args;
+    if(iss >> limit) iss >> offset;
+    query_args = toLowerCase(query_args);
+    offset = max(offset, 0);
+
+    // 'limit'/'offset' no fim da linha valem como N e offset, usando o ranking do prefixo.
+    if(limit < 0 && options.limit >= 0){
+        limit = options.limit;
+        offset = options.offset;
+        options.limit = -1;
+        options.offset = 0;
+    }
+
+    const int* ranked = nullptr;
+    size_t rankedCount = 0;
+
+    if(limit >= 0 && db.playerNames.ranked(query_args, ranked, rankedCount) && (size_t) (offset + limit) <= rankedCount){
+        // A página está dentro do ranking pré-calculado do prefixo: leitura direta.
+        player_id_list.assign(ranked + offset, ranked + offset + limit);
+    }
+    else{
+        // Caso geral: coleta toda a subárvore e ordena pela nota global.
+        player_id_list.clear();
+        db.playerNames.startsWith(query_args, player_id_list);
+        sortByKey(player_id_list, RankKey{&db.players}, scratch.sort);
+
+        size_t first = min((size_t) offset, player_id_list.size());
+        size_t last = (limit < 0) ? player_id_list.size() : min(first + limit, player_id_list.size());
+        player_id_list.erase(player_id_list.begin() + last, player_id_list.end());
+        player_id_list.erase(player_id_list.begin(), player_id_list.begin() + first);
+    }
+
+    ResultWriter writer(scratch.output, options);
+    writer.begin(PLAYER_COLUMNS, COLUMN_COUNT(PLAYER_COLUMNS));
+    for(auto j : player_id_list){
+        int index = db.players.find(j);
+        if(index < 0) continue;
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        PlayerView k = db.players.view(index);
+        writer.value(k.id);
+        writer.value(k.short_name);
+        writer.value(k.long_name);
+        writer.value(k.player_positions);
+        writer.value(k.rating);
+        writer.value(k.total_ratings);
+        writer.endRow();
+    }
+    writer.end();
+}
+
+// Pesq 2: User <user_id> [N]
+void queryUser(const Database &db, istringstream &iss, QueryScratch &scratch, const RenderOptions &options){
+    string query_args;
+    int key;
+    int limit = USER_TOP_K;
+    iss >> query_args;
+    if(!(iss >> limit)) limit = USER_TOP_K;
+
+    const User* userPtr = nullptr;
+    if(parseInt(query_args, key)) hashSearch(db.users, key, userPtr);
+
+    ResultWriter writer(scratch.output, options);
+    if(!userPtr){
+        writer.message("Usuario nao encontrado: " + query_args);
+        return;
+    }
+
+    // Pares (chave, posição na lista de avaliações), com a chave composta (nota do usuário,
+    // nota global), ambas decrescentes; empates pelo menor sofifa_id. Uma seleção parcial
+    // ordena só as N primeiras. Jogadores fora da base não entram.
+    RatingSpan span = db.userRatings.current(userPtr->index, scratch.ratings);
+    vector<SortItem> &items = scratch.sort.items;
+    items.clear();
+    for(size_t i = 0; i < span.size(); i++){
+        int index = db.players.find(span[i].id);
+        if(index < 0) continue;
+        items.push_back({((uint64_t) floatKeyDesc(span[i].rating) << 32) | floatKeyDesc(db.players.rating(index)), (uint32_t) i});
+    }
+    size_t shown = min(items.size(), (size_t) max(limit, 0));
+    partial_sort(items.begin(), items.begin() + shown, items.end(), [&](const SortItem &a, const SortItem &b){
+        return a.key != b.key ? a.key < b.key : span[a.index].id < span[b.index].id;
+    });
+
+    // N limita as linhas antes da página (limit/offset).
+    writer.begin(USER_COLUMNS, COLUMN_COUNT(USER_COLUMNS));
+    for(size_t i = 0; i < shown; i++){
+        const Rating &r = span[items[i].index];
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        PlayerView k = db.players.view(db.players.find(r.id));
+        writer.value(k.id);
+        writer.value(k.short_name);
+        writer.value(k.long_name);
+        writer.value(k.rating);
+        writer.value(k.total_ratings);
+        writer.value(r.rating);
+        writer.endRow();
+    }
+    writer.end();
+}
+
+// Palavras da linha; um trecho entre apóstrofes ('FC Barcelona') conta como uma palavra.
+void splitQuoted(const string &line, vector<string> &words){
+    words.clear();
+    size_t i = 0;
+    while(i < line.size()){
+        if(line[i] == ' ' || line[i] == '\t' || line[i] == '\r'){
+            i++;
+            continue;
+        }
+        size_t start = i;
+        size_t end;
+        if(line[i] == '\''){
+            start++;
+            end = line.find('\'', start);
+            if(end == string::npos) end = line.size();
+            i = end + 1;
+        }
+        else{
+            end = line.find_first_of(" \t\r", start);
+            if(end == string::npos) end = line.size();
+            i = end;
+        }
+        words.emplace_back(line, start, end - start);
+    }
+}
+
+// Filtros do 'top' e a coluna de cada um.
+const char* FILTER_NAMES[PLAYER_CATEGORY_FIELDS] = {"nation", "club", "league"};
+const char* FILTER_UNKNOWN[PLAYER_CATEGORY_FIELDS] = {"Nacionalidade desconhecida: ", "Clube desconhecido: ", "Liga desconhecida: "};
+
+// Coluna do filtro 'name', ou -1 se não for um filtro.
+int filterField(const string &name){
+    string lower = toLowerCase(name);
+    for(int c = 0; c < PLAYER_CATEGORY_FIELDS; c++){
+        if(lower == FILTER_NAMES[c]) return PLAYER_FREE_FIELDS + c;
+    }
+    return -1;
+}
+
+// Pesq 3: Top <N> [position] [nation|club|league '<nome>']...
+void queryTop(const Database &db, istringstream &iss, QueryScratch &scratch, const RenderOptions &options){
+    int N = 0;
+    string position, filters;
+
+    // N, depois a posição (opcional se houver filtros) e os pares filtro/valor.
+    iss >> N;
+    getline(iss, filters);
+    vector<string> &words = scratch.tag_list;
+    splitQuoted(filters, words);
+
+    size_t w = 0;
+    if(w < words.size() && filterField(words[w]) < 0) position = words[w++];
+
+    // Como as posições estão armazenadas em letras maiusculas,
+    // normaliza o input do usuário para letras maiusculas.
+    position = toUpperCase(position);
+    int code = positionCode(position);
+
+    ResultWriter writer(scratch.output, options);
+    if(code < 0 && (!position.empty() || w == words.size())){
+        writer.message("Posicao desconhecida: " + position);
+        return;
+    }
+
+    vector<const PostingList*> &lists = scratch.intersect.lists;
+    lists.clear();
+    for(; w < words.size(); w += 2){
+        int field = filterField(words[w]);
+        if(field < 0 || w + 1 == words.size()){
+            writer.message("Uso: top <N> [posicao] [nation|club|league '<nome>']...");
+            return;
+        }
+        const PostingList* list = db.filterIndex.find((PlayerField) field, words[w + 1]);
+        if(!list){
+            writer.message(FILTER_UNKNOWN[field - PLAYER_FREE_FIELDS] + words[w + 1]);
+            return;
+        }
+        lists.push_back(list);
+    }
+
+    writer.begin(FULL_COLUMNS, COLUMN_COUNT(FULL_COLUMNS));
+    if(lists.empty()){
+        // Só a posição: lista já ordenada e restrita a jogadores com 1000+ avaliações.
+        const vector<int> &ranked = db.positionIndex.players(code);
+        for(int i = 0; i < N && i < (int) ranked.size(); i++){
+            if(!writer.beginRow()){
+                if(writer.pageFull()) break;
+                continue;
+            }
+            writeFullRow(writer, db.players.view(db.players.find(ranked[i])));
+        }
+        writer.end();
+        return;
+    }
+
+    // Com filtros: interseção das listas dos predicados (índices de jogador), restrita aos
+    // jogadores elegíveis ao top e ordenada pela nota global.
+    if(code >= 0) lists.push_back(db.filterIndex.position(code));
+    vector<int> &player_index_list = scratch.player_id_list;
+    intersectPostings(scratch.intersect, player_index_list);
+    player_index_list.erase(remove_if(player_index_list.begin(), player_index_list.end(),
+                                      [&](int index){ return !topEligible(db.players, index); }), player_index_list.end());
+    sortByKey(player_index_list, [&](int index){ return rankKey(db.players.rating(index), db.players.id(index)); }, scratch.sort);
+
+    for(int i = 0; i < N && i < (int) player_index_list.size(); i++){
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        writeFullRow(writer, db.players.view(player_index_list[i]));
+    }
+    writer.end();
+}
+
+// Pesq 4: tags <list of tags>
+void queryTags(const Database &db, istringstream &iss, QueryScratch &scratch, const RenderOptions &options){
+    vector<int> &player_id_list = scratch.player_id_list;
+
+    // Realiza o parsing do restante da linha escrita pelo usuário.
+    // tags são retornadas no vector tag_list.
+    scratch.tag_list = parseTags(iss);
+
+    // Interseção das listas de todas as tags (ordem crescente de sofifa_id),
+    // depois ordenada pela nota global.
+    db.tagIndex.intersect(scratch.tag_list, scratch.intersect, player_id_list);
+    sortByKey(player_id_list, RankKey{&db.players}, scratch.sort);
+
+    ResultWriter writer(scratch.output, options);
+    writer.begin(FULL_COLUMNS, COLUMN_COUNT(FULL_COLUMNS));
+    for(auto id : player_id_list){
+        int index = db.players.find(id);
+        if(index < 0) continue;
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        writeFullRow(writer, db.players.view(index));
+    }
+    writer.end();
+}
+
+// Pesq 5: contains <texto>
+// Jogadores com o texto em qualquer parte do short_name ou do long_name, pela nota global.
+void queryContains(const Database &db, istringstream &iss, QueryScratch &scratch, const RenderOptions &options){
+    string text;
+    getline(iss >> ws, text);
+    text = toLowerCase(text.substr(0, text.find_last_not_of(" \t\r") + 1));
+
+    vector<int> &player_index_list = scratch.player_id_list;
+    db.nameIndex.search(text, scratch.intersect, player_index_list);
+    sortByKey(player_index_list, [&](int index){ return rankKey(db.players.rating(index), db.players.id(index)); }, scratch.sort);
+
+    ResultWriter writer(scratch.output, options);
+    writer.begin(PLAYER_COLUMNS, COLUMN_COUNT(PLAYER_COLUMNS));
+    for(auto index : player_index_list){
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        PlayerView k = db.players.view(index);
+        writer.value(k.id);
+        writer.value(k.short_name);
+        writer.value(k.long_name);
+        writer.value(k.player_positions);
+        writer.value(k.rating);
+        writer.value(k.total_ratings);
+        writer.endRow();
+    }
+    writer.end();
+}
+
+// Pesq 6: similar <sofifa_id> [N] [common|corr]
+// Jogadores mais avaliados pelos mesmos usuários que o jogador (common, padrão) ou com maior
+// correlação das notas (corr), lidos da tabela de co-ocorrência.
+void querySimilar(const Database &db, istringstream &iss, QueryScratch &scratch, const RenderOptions &options){
+    string query_args, word;
+    int key, limit = SIMILAR_DEFAULT_N;
+    SimilarOrder order = SIMILAR_COMMON;
+    iss >> query_args;
+
+    ResultWriter writer(scratch.output, options);
+    while(iss >> word){
+        word = toLowerCase(word);
+        if(word == "common") order = SIMILAR_COMMON;
+        else if(word == "corr") order = SIMILAR_CORRELATION;
+        else if(!parseInt(word, limit) || limit < 0){
+            writer.message("Uso: similar <sofifa_id> [N] [common|corr]");
+            return;
+        }
+    }
+
+    int index = parseInt(query_args, key) ? db.players.find(key) : -1;
+    if(index < 0){
+        writer.message("Jogador nao encontrado: " + query_args);
+        return;
+    }
+    if(db.similar.empty()){
+        writer.message("Tabela de similares indisponivel (use --similar ou um snapshot gravado com ela).");
+        return;
+    }
+
+    SimilarSpan neighbors = db.similar.neighbors(index, order);
+    writer.begin(SIMILAR_COLUMNS, COLUMN_COUNT(SIMILAR_COLUMNS));
+    for(size_t i = 0; i < neighbors.size() && (int) i < limit; i++){
+        if(!writer.beginRow()){
+            if(writer.pageFull()) break;
+            continue;
+        }
+        const SimilarEntry &entry = neighbors.first[i];
+        PlayerView k = db.players.view(entry.index);
+        writer.value(k.id);
+        writer.value(k.short_name);
+        writer.value(k.long_name);
+        writer.value(k.player_positions);
+        writer.value(k.rating);
+        writer.value(k.total_ratings);
+        writer.value((int) entry.common);
+        writer.value(entry.similarity);
+        writer.endRow();
+    }
+    writer.end();
+}
+
+// Pesq 7: stats [json]
+// Tempos da carga, tabelas hash, tries, memória por estrutura e latência das pesquisas.
+void queryStats(const Database &db, istringstream &iss, ostream &out){
+    string format;
+    iss >> format;
+    bool json = toLowerCase(format) == "json";
+
+    HashStats playerHash = hashStats(db.players.idTable());
+    HashStats userHash = hashStats(db.users);
+
+    // {nome, bytes}
+    pair<const char*, size_t> memory[] = {
+        {"players", db.players.memoryBytes()},
+        {"players_hash", playerHash.bytes},
+        {"users_hash", userHash.bytes},
+        {"ratings", db.userRatings.memoryBytes()},
+        {"name_trie", db.playerNames.memoryBytes()},
+        {"tag_index", db.tagIndex.memoryBytes()},
+        {"position_index", db.positionIndex.memoryBytes()},
+        {"name_index", db.nameIndex.memoryBytes()},
+        {"filter_index", db.filterIndex.memoryBytes()},
+        {"similar_table", db.similar.memoryBytes()},
+        {"process_rss", residentBytes()}
+    };
+
+    out << fixed << setprecision(3);
+    if(json){
+        out << "{\"loading\": " << (db.loadStage < LOAD_COMPLETE ? "true" : "false") << ", \"load_percent\": " << loadPercent(db)
+            << ", \"phases\": [";
+        for(size_t i = 0; i < db.phases.size(); i++){
+            const PhaseTiming &phase = db.phases[i];
+            out << (i ? ", " : "") << "{\"name\": \"" << phase.name << "\", \"seconds\": " << phase.seconds << ", \"rows\": " << phase.rows
+                << ", \"rows_per_s\": " << (phase.seconds > 0 ? phase.rows / phase.seconds : 0) << "}";
+        }
+        out << "], \"players_hash\": ";
+        printHashStatsJson(playerHash, out);
+        out << ", \"users_hash\": ";
+        printHashStatsJson(userHash, out);
+        out << ", \"players\": {\"count\": " << db.players.size() << ", \"nationalities\": " << db.players.category(NATIONALITY).size()
+            << ", \"clubs\": " << db.players.category(CLUB_NAME).size() << ", \"leagues\": " << db.players.category(LEAGUE_NAME).size() << "}";
+        out << ", \"name_trie\": {\"nodes\": " << db.playerNames.nodeCount() << ", \"words\": " << db.playerNames.wordCount()
+            << ", \"bytes\": " << db.playerNames.memoryBytes() << "}";
+        out << ", \"tag_index\": {\"tags\": " << db.tagIndex.tagCount() << ", \"dictionary_nodes\": " << db.tagIndex.tagDictionary().nodeCount()
+            << ", \"bytes\": " << db.tagIndex.memoryBytes() << "}";
+        out << ", \"name_index\": {\"trigrams\": " << db.nameIndex.trigramCount() << ", \"bytes\": " << db.nameIndex.memoryBytes() << "}";
+        out << ", \"similar_table\": {\"players\": " << db.similar.playerCount() << ", \"bytes\": " << db.similar.memoryBytes() << "}";
+        out << ", \"ratings\": {\"users\": " << db.userRatings.userCount() << ", \"ratings\": " << db.userRatings.ratingCount()
+            << ", \"updates\": " << db.userRatings.updateCount() << ", \"mapped\": " << (db.userRatings.mapped() ? "true" : "false") << "}";
+        out << ", \"memory\": {";
+        for(size_t i = 0; i < sizeof(memory) / sizeof(memory[0]); i++) out << (i ? ", " : "") << "\"" << memory[i].first << "\": " << memory[i].second;
+        out << "}, \"queries\": {";
+        bool first = true;
+        for(int type = 0; type < QUERY_TYPES; type++){
+            const QueryCounters &counters = db.queryCounters[type];
+            if(counters.count == 0) continue;
+            out << (first ? "" : ", ") << "\"" << QUERY_NAMES[type] << "\": {\"count\": " << counters.count << ", \"mean_us\": " << counters.meanUs()
+                << ", \"p50_us\": " << counters.percentileUs(0.50) << ", \"p99_us\": " << counters.percentileUs(0.99)
+                << ", \"max_us\": " << counters.maxNs / 1000.0 << "}";
+            first = false;
+        }
+        out << "}}" << endl;
+        return;
+    }
+
+    out << endl << "Carga:" << endl;
+    if(db.loadStage < LOAD_COMPLETE) out << "  avaliacoes em carga (" << loadPercent(db) << "%)" << endl;
+    for(const auto &phase : db.phases){
+        out << "  " << setw(24) << left << phase.name << right << setw(10) << phase.seconds << " s";
+        if(phase.rows) out << setw(12) << phase.rows << " linhas" << setw(14) << setprecision(0) << (phase.seconds > 0 ? phase.rows / phase.seconds : 0) << " linhas/s" << setprecision(3);
+        out << endl;
+    }
+
+    out << endl << "Hash de jogadores:" << endl;
+    printHashStats(playerHash, out);
+    out << "Hash de usuarios:" << endl;
+    printHashStats(userHash, out);
+
+    out << "Jogadores: " << db.players.size() << ", " << db.players.category(NATIONALITY).size() << " nacionalidades, "
+        << db.players.category(CLUB_NAME).size() << " clubes, " << db.players.category(LEAGUE_NAME).size() << " ligas" << endl;
+    out << "Trie de nomes: " << db.playerNames.nodeCount() << " nodos, " << db.playerNames.wordCount() << " palavras, "
+        << db.playerNames.memoryBytes() << " bytes" << endl;
+    out << "Indice de tags: " << db.tagIndex.tagCount() << " tags, " << db.tagIndex.tagDictionary().nodeCount() << " nodos, "
+        << db.tagIndex.memoryBytes() << " bytes" << endl;
+    out << "Indice de trigramas: " << db.nameIndex.trigramCount() << " trigramas, " << db.nameIndex.memoryBytes() << " bytes" << endl;
+    out << "Tabela de similares: " << db.similar.playerCount() << " jogadores, " << db.similar.memoryBytes() << " bytes" << endl;
+    out << "Avaliacoes: " << db.userRatings.userCount() << " usuarios, " << db.userRatings.ratingCount() << " avaliacoes, "
+        << db.userRatings.updateCount() << " atualizacoes" << (db.userRatings.mapped() ? " (snapshot mapeado)" : "") << endl;
+
+    out << endl << "Memoria (bytes):" << endl;
+    for(const auto &entry : memory) out << "  " << setw(24) << left << entry.first << right << setw(14) << entry.second << endl;
+
+    out << endl << "Pesquisas (us):" << endl;
+    for(int type = 0; type < QUERY_TYPES; type++){
+        const QueryCounters &counters = db.queryCounters[type];
+        if(counters.count == 0) continue;
+        out << "  " << setw(14) << left << QUERY_NAMES[type] << right << setw(8) << counters.count
+            << "  media " << setw(10) << counters.meanUs() << "  p50 " << setw(10) << counters.percentileUs(0.50)
+            << "  p99 " << setw(10) << counters.percentileUs(0.99) << "  max " << setw(10) << counters.maxNs / 1000.0 << endl;
+    }
+}
+
+// Tipo da pesquisa pela primeira palavra da linha.
+QueryType queryType(const string &line){
+    istringstream iss(line);
+    string word;
+    iss >> word;
+    word = toLowerCase(word);
+    for(int type = 0; type < QUERY_UNKNOWN; type++){
+        if(word == QUERY_NAMES[type]) return (QueryType) type;
+    }
+    return QUERY_UNKNOWN;
+}
+
+// Etapa da carga de que a pesquisa precisa. 'player', 'contains' e 'tags' respondem já
+// com os jogadores, marcando o resultado como parcial enquanto faltam as médias.
+LoadStage requiredStage(QueryType type){
+    switch(type){
+        case QUERY_TOP:     return LOAD_TOTALS;
+        case QUERY_USER:
+        case QUERY_SIMILAR:
+        case QUERY_RATE:    return LOAD_COMPLETE;
+        default:            return LOAD_PLAYERS;
+    }
+}
+
+// Executa uma linha de pesquisa e escreve o resultado em 'out'. Retorna o tipo da pesquisa.
+QueryType runQuery(const Database &db, const string &input, QueryScratch &scratch, ostream &out){
+    auto start = chrono::steady_clock::now();
+
+    // Opções de saída no fim da linha (limit/offset/format); o resto é a pesquisa.
+    string line = input;
+    RenderOptions options;
+    options.format = scratch.format;
+    parseRenderOptions(line, options);
+
+    istringstream iss(line);
+    string query_type;
+    iss >> query_type;
+    query_type = toLowerCase(query_type);
+
+    scratch.output.clear();
+    QueryType type = QUERY_UNKNOWN;
+    if(query_type == "player"){
+        type = QUERY_PLAYER;
+        queryPlayer(db, iss, scratch, options);
+    }
+    else if(query_type == "user"){
+        type = QUERY_USER;
+        queryUser(db, iss, scratch, options);
+    }
+    else if(query_type == "top"){
+        type = QUERY_TOP;
+        queryTop(db, iss, scratch, options);
+    }
+    else if(query_type == "tags"){
+        type = QUERY_TAGS;
+        queryTags(db, iss, scratch, options);
+    }
+    else if(query_type == "contains"){
+        type = QUERY_CONTAINS;
+        queryContains(db, iss, scratch, options);
+    }
+    else if(query_type == "similar"){
+        type = QUERY_SIMILAR;
+        querySimilar(db, iss, scratch, options);
+    }
+    else if(query_type == "stats"){
+        type = QUERY_STATS;
+        queryStats(db, iss, out);
+    }
+    else if(query_type == "sair") type = QUERY_QUIT;
+    else if(options.format == FORMAT_TABLE){
+        // Default: comando desconhecido
+        scratch.output += "Comando desconhecido.";
+    }
+    else ResultWriter(scratch.output, options).message("Comando desconhecido.");
+
+    if(db.loadStage < LOAD_TOTALS && (type == QUERY_PLAYER || type == QUERY_CONTAINS || type == QUERY_TAGS)){
+        ResultWriter(scratch.output, options).message("Resultado parcial: avaliacoes em carga (" + to_string(loadPercent(db))
+                                                      + "%), notas e ordem ainda sem elas.");
+    }
+
+    // A linha em branco depois do resultado é só do formato table.
+    if(options.format == FORMAT_TABLE) scratch.output += '\n';
+    out.write(scratch.output.data(), scratch.output.size());
+
+    db.queryCounters[type].record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    return type;
+}
@@ -0,0 +1,188 @@
+// rating-utils.hpp
+// trshpnd 2024
+//
+// Avaliações dos usuários em formato CSR (compressed sparse row): um único vetor com os
+// pares (sofifa_id, rating) agrupados por usuário e um vetor de offsets indexado pelo
+// índice denso do usuário. As avaliações do usuário i ocupam entries[offsets[i], offsets[i+1]).
+// Avaliações recebidas depois da carga (comando 'rate') ficam em listas por usuário, por
+// cima do CSR, até serem incorporadas a ele (mergeUpdates, antes de gravar um snapshot).
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "player-utils.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Intervalo contíguo de avaliações de um usuário.
+struct RatingSpan {
+    const Rating* first = nullptr;
+    const Rating* last = nullptr;
+
+    const Rating* begin() const { return first; }
+    const Rating* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    const Rating& operator[](size_t i) const { return first[i]; }
+};
+
+class RatingStore {
+private:
+    // O CSR não muda depois da carga, então cópias do RatingStore o compartilham (só as
+    // atualizações são copiadas).
+    shared_ptr<vector<uint64_t>> ownedOffsets;
+    shared_ptr<vector<Rating>> ownedEntries;
+    shared_ptr<const MappedFile> mapping;   // Mantém o arquivo mapeado enquanto os dados apontam para ele.
+
+    const uint64_t* offsetData = nullptr;
+    const Rating* entryData = nullptr;
+    size_t users = 0;
+
+    vector<vector<Rating>> updates;         // Indexado pelo índice do usuário; pode ir além de 'users'.
+    size_t updateTotal = 0;
+
+    // Posição de 'playerId' na lista, ou -1.
+    static long indexOf(const Rating* first, size_t count, int playerId) {
+        for (size_t i = 0; i < count; i++) {
+            if (first[i].id == playerId) return i;
+        }
+        return -1;
+    }
+
+public:
+    RatingStore() = default;
+    RatingStore(RatingStore&&) = default;
+    RatingStore& operator=(RatingStore&&) = default;
+    RatingStore(const RatingStore&) = default;
+    RatingStore& operator=(const RatingStore&) = default;
+
+    // Monta o layout a partir do número de avaliações de cada usuário (índice denso).
+    // As posições ficam reservadas e devem ser preenchidas via mutableEntries().
+    void allocate(const vector<uint64_t> &counts) {
+        ownedOffsets = make_shared<vector<uint64_t>>(counts.size() + 1, 0);
+        vector<uint64_t>& offsets = *ownedOffsets;
+        for (size_t i = 0; i < counts.size(); i++) offsets[i + 1] = offsets[i] + counts[i];
+        ownedEntries = make_shared<vector<Rating>>(offsets.back());
+
+        mapping.reset();
+        offsetData = ownedOffsets->data();
+        entryData = ownedEntries->data();
+        users = counts.size();
+        updates.clear();
+        updateTotal = 0;
+    }
+
+    // Usa dados já no layout CSR que vivem em um arquivo mapeado (sem cópia).
+    void attach(shared_ptr<const MappedFile> file, const uint64_t* offsets, const Rating* entries, size_t userCount) {
+        ownedOffsets.reset();
+        ownedEntries.reset();
+
+        mapping = std::move(file);
+        offsetData = offsets;
+        entryData = entries;
+        users = userCount;
+        updates.clear();
+        updateTotal = 0;
+    }
+
+    Rating* mutableEntries() { return ownedEntries->data(); }
+
+    size_t userCount() const { return users; }
+    // Índices de usuário em uso, contando os que só têm atualizações.
+    size_t indexCount() const { return max(users, updates.size()); }
+    size_t ratingCount() const { return users ? offsetData[users] : 0; }
+    const uint64_t* offsets() const { return offsetData; }
+    const Rating* entries() const { return entryData; }
+
+    size_t updateCount() const { return updateTotal; }
+
+    // Bytes em uso; 'mapped' indica se estão no arquivo mapeado em vez de na heap.
+    size_t memoryBytes() const {
+        size_t bytes = users ? (users + 1) * sizeof(uint64_t) + ratingCount() * sizeof(Rating) : 0;
+        bytes += updates.capacity() * sizeof(vector<Rating>);
+        for (const auto& list : updates) bytes += list.capacity() * sizeof(Rating);
+        return bytes;
+    }
+    bool mapped() const { return (bool) mapping; }
+
+    RatingSpan ratings(size_t index) const {
+        if (index >= users) return RatingSpan();
+        return {entryData + offsetData[index], entryData + offsetData[index + 1]};
+    }
+
+    // Nota atual do usuário para o jogador, considerando as atualizações. false se não avaliou.
+    bool find(size_t index, int playerId, float& rating) const {
+        if (index < updates.size()) {
+            long i = indexOf(updates[index].data(), updates[index].size(), playerId);
+            if (i >= 0) {
+                rating = updates[index][i].rating;
+                return true;
+            }
+        }
+        RatingSpan span = ratings(index);
+        long i = indexOf(span.begin(), span.size(), playerId);
+        if (i < 0) return false;
+        rating = span[i].rating;
+        return true;
+    }
+
+    // Grava a avaliação do usuário, substituindo uma anterior para o mesmo jogador.
+    void update(size_t index, Rating oRating) {
+        if (index >= updates.size()) updates.resize(index + 1);
+        vector<Rating>& list = updates[index];
+        long i = indexOf(list.data(), list.size(), oRating.id);
+        if (i >= 0) list[i] = oRating;
+        else {
+            list.push_back(oRating);
+            updateTotal++;
+        }
+    }
+
+    // Avaliações do usuário com as atualizações aplicadas: as da carga na ordem original
+    // (com a nota nova, se trocada) e depois as novas, na ordem de chegada. Só copia para
+    // 'scratch' se o usuário tiver atualizações.
+    RatingSpan current(size_t index, vector<Rating>& scratch) const {
+        RatingSpan span = ratings(index);
+        if (index >= updates.size() || updates[index].empty()) return span;
+
+        scratch.assign(span.begin(), span.end());
+        size_t loaded = scratch.size();
+        for (const Rating& oRating : updates[index]) {
+            long i = indexOf(scratch.data(), loaded, oRating.id);
+            if (i >= 0) scratch[i] = oRating;
+            else scratch.push_back(oRating);
+        }
+        return {scratch.data(), scratch.data() + scratch.size()};
+    }
+
+    // Incorpora as atualizações ao CSR, que passa a ficar na heap.
+    void mergeUpdates() {
+        if (updates.empty()) return;
+
+        size_t userTotal = max(users, updates.size());
+        vector<uint64_t> mergedOffsets(1, 0);
+        vector<Rating> mergedEntries, scratch;
+        mergedOffsets.reserve(userTotal + 1);
+        mergedEntries.reserve(ratingCount() + updateTotal);
+
+        for (size_t index = 0; index < userTotal; index++) {
+            RatingSpan span = current(index, scratch);
+            mergedEntries.insert(mergedEntries.end(), span.begin(), span.end());
+            mergedOffsets.push_back(mergedEntries.size());
+        }
+
+        ownedOffsets = make_shared<vector<uint64_t>>(std::move(mergedOffsets));
+        ownedEntries = make_shared<vector<Rating>>(std::move(mergedEntries));
+        mapping.reset();
+        offsetData = ownedOffsets->data();
+        entryData = ownedEntries->data();
+        users = userTotal;
+        updates.clear();
+        updateTotal = 0;
+    }
+};
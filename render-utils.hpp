@@ -0,0 +1,308 @@
+// render-utils.hpp
+// trshpnd 2024
+//
+// Saída das pesquisas. As linhas do resultado são formatadas em um buffer reaproveitado
+// entre pesquisas (sem ostream nem flush por linha) e o buffer é escrito de uma vez ao fim
+// da pesquisa. Formatos:
+//   table   colunas de largura fixa (a saída original do menu)
+//   tsv     cabeçalho com os nomes das colunas e uma linha por resultado, separadas por tab
+//   jsonl   um objeto JSON por resultado
+//   binary  quadro binário little-endian em qualquer host (ver ResultWriter::begin)
+// O ResultWriter também aplica a paginação (offset/limit) sobre as linhas.
+
+#pragma once
+
+#include "csv-utils.hpp"
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+using namespace std;
+
+enum OutputFormat {
+    FORMAT_TABLE,
+    FORMAT_TSV,
+    FORMAT_JSONL,
+    FORMAT_BINARY,
+    OUTPUT_FORMATS
+};
+
+const char* FORMAT_NAMES[OUTPUT_FORMATS] = {"table", "tsv", "jsonl", "binary"};
+
+// Código do formato, ou -1 se desconhecido.
+int formatCode(string_view name){
+    for(int i = 0; i < OUTPUT_FORMATS; i++){
+        if(name == FORMAT_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+enum ColumnType : uint8_t {
+    COLUMN_INT,
+    COLUMN_FLOAT,
+    COLUMN_TEXT
+};
+
+// Coluna de um resultado. 'width', 'precision' e 'after' (texto depois do campo) definem o
+// formato table.
+struct Column {
+    const char* name;
+    ColumnType type;
+    int width;
+    int precision;
+    const char* after;
+};
+
+// Opções de saída de uma pesquisa: formato e página (limit < 0 = sem limite).
+struct RenderOptions {
+    OutputFormat format = FORMAT_TABLE;
+    long limit = -1;
+    long offset = 0;
+};
+
+// Extrai do fim da linha os pares "limit <n>", "offset <n>" e "format <nome>", deixando
+// na linha só a pesquisa. Os valores ausentes ficam com os de 'options'.
+void parseRenderOptions(string &line, RenderOptions &options){
+    while(true){
+        size_t end = line.find_last_not_of(" \t\r");
+        if(end == string::npos) return;
+        size_t valueStart = line.find_last_of(" \t", end);
+        if(valueStart == string::npos) return;
+        size_t keyEnd = line.find_last_not_of(" \t", valueStart);
+        if(keyEnd == string::npos) return;
+        size_t keyStart = line.find_last_of(" \t", keyEnd);
+        if(keyStart == string::npos) return;    // A primeira palavra é o comando.
+
+        string_view key = string_view(line).substr(keyStart + 1, keyEnd - keyStart);
+        string_view value = string_view(line).substr(valueStart + 1, end - valueStart);
+        int number, code;
+        if(key == "limit" && parseInt(value, number) && number >= 0) options.limit = number;
+        else if(key == "offset" && parseInt(value, number) && number >= 0) options.offset = number;
+        else if(key == "format" && (code = formatCode(value)) >= 0) options.format = (OutputFormat) code;
+        else return;
+        line.resize(keyStart);
+    }
+}
+
+class ResultWriter {
+private:
+    string &buffer;
+    RenderOptions options;
+    const Column* columns = nullptr;
+    int columnCount = 0;
+    int field = 0;
+    long seen = 0;              // Linhas oferecidas (beginRow), dentro ou fora da página.
+    uint32_t rows = 0;          // Linhas escritas.
+    size_t rowCountAt = 0;      // Posição do contador de linhas no quadro binário.
+
+    // Grava 'value' byte a byte, do menos para o mais significativo, qualquer que seja a
+    // ordem de bytes do host. Floats vão pelos bits da representação IEEE.
+    template <typename T>
+    static void storeLittle(char* out, T value){
+        using Bits = conditional_t<sizeof(T) == 1, uint8_t, conditional_t<sizeof(T) == 2, uint16_t,
+                     conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+        static_assert(sizeof(Bits) == sizeof(T), "tipo sem inteiro do mesmo tamanho");
+        Bits bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for(size_t i = 0; i < sizeof(bits); i++) out[i] = (char) (bits >> (8 * i));
+    }
+
+    template <typename T>
+    void appendRaw(T value){
+        char bytes[sizeof(T)];
+        storeLittle(bytes, value);
+        buffer.append(bytes, sizeof(bytes));
+    }
+
+    void pad(size_t length, int width){
+        if((int) length < width) buffer.append(width - length, ' ');
+    }
+
+    void appendJsonString(string_view text){
+        buffer += '"';
+        for(char ch : text){
+            if(ch == '"' || ch == '\\'){
+                buffer += '\\';
+                buffer += ch;
+            }
+            else if((unsigned char) ch < 0x20){
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                buffer += escaped;
+            }
+            else buffer += ch;
+        }
+        buffer += '"';
+    }
+
+    // Separador antes do campo e nome da coluna (jsonl).
+    void openField(){
+        const Column &column = columns[field];
+        if(options.format == FORMAT_TSV && field > 0) buffer += '\t';
+        if(options.format == FORMAT_JSONL){
+            buffer += field > 0 ? ", \"" : "{\"";
+            buffer += column.name;
+            buffer += "\": ";
+        }
+    }
+
+    void closeField(){
+        if(options.format == FORMAT_TABLE) buffer += columns[field].after;
+        field++;
+    }
+
+    // Campo já formatado como texto (números), alinhado à direita no formato table.
+    void appendFormatted(const char* text, size_t length){
+        openField();
+        if(options.format == FORMAT_TABLE) pad(length, columns[field].width);
+        buffer.append(text, length);
+        closeField();
+    }
+
+public:
+    ResultWriter(string &out, const RenderOptions &renderOptions) : buffer(out), options(renderOptions) {}
+
+    OutputFormat format() const { return options.format; }
+
+    // Início do resultado. No formato binary, o quadro é:
+    //   uint8 1 | uint16 colunas | por coluna: uint8 tipo, uint8 tamanho, nome |
+    //   uint32 linhas | linhas (int32, float32, ou uint16 tamanho + bytes para texto)
+    void begin(const Column* resultColumns, int count){
+        columns = resultColumns;
+        columnCount = count;
+        seen = 0;
+        rows = 0;
+
+        switch(options.format){
+            case FORMAT_TABLE:
+                buffer += '\n';
+                break;
+            case FORMAT_TSV:
+                for(int c = 0; c < count; c++){
+                    if(c > 0) buffer += '\t';
+                    buffer += columns[c].name;
+                }
+                buffer += '\n';
+                break;
+            case FORMAT_JSONL:
+                break;
+            case FORMAT_BINARY:
+                appendRaw<uint8_t>(1);
+                appendRaw<uint16_t>(count);
+                for(int c = 0; c < count; c++){
+                    appendRaw<uint8_t>(columns[c].type);
+                    appendRaw<uint8_t>(strlen(columns[c].name));
+                    buffer += columns[c].name;
+                }
+                rowCountAt = buffer.size();
+                appendRaw<uint32_t>(0);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Próxima linha do resultado. Retorna false se ela estiver fora da página; nesse caso
+    // os campos não devem ser escritos.
+    bool beginRow(){
+        long index = seen++;
+        if(index < options.offset || pageFull()) return false;
+        field = 0;
+        return true;
+    }
+
+    // true se a página já está completa (as próximas linhas seriam descartadas).
+    bool pageFull() const {
+        return options.limit >= 0 && (long) rows >= options.limit;
+    }
+
+    void value(int number){
+        if(options.format == FORMAT_BINARY){
+            appendRaw<int32_t>(number);
+            field++;
+            return;
+        }
+        char text[16];
+        auto result = to_chars(text, text + sizeof(text), number);
+        appendFormatted(text, result.ptr - text);
+    }
+
+    void value(float number){
+        if(options.format == FORMAT_BINARY){
+            appendRaw<float>(number);
+            field++;
+            return;
+        }
+        char text[64];
+        auto result = to_chars(text, text + sizeof(text), number, chars_format::fixed, columns[field].precision);
+        appendFormatted(text, result.ptr - text);
+    }
+
+    void value(string_view text){
+        switch(options.format){
+            case FORMAT_BINARY:
+                text = text.substr(0, UINT16_MAX);
+                appendRaw<uint16_t>(text.size());
+                buffer.append(text);
+                field++;
+                return;
+            case FORMAT_JSONL:
+                openField();
+                appendJsonString(text);
+                break;
+            case FORMAT_TSV:
+                openField();
+                for(char ch : text) buffer += (ch == '\t' || ch == '\n' || ch == '\r') ? ' ' : ch;
+                break;
+            default:
+                openField();
+                pad(text.size(), columns[field].width);
+                buffer.append(text);
+                break;
+        }
+        closeField();
+    }
+
+    void endRow(){
+        if(options.format == FORMAT_JSONL) buffer += "}\n";
+        else if(options.format != FORMAT_BINARY) buffer += '\n';
+        rows++;
+    }
+
+    // Fim do resultado: no formato binary, grava o número de linhas no quadro.
+    void end(){
+        if(options.format == FORMAT_BINARY) storeLittle(&buffer[rowCountAt], rows);
+    }
+
+    // Mensagem no lugar de um resultado (ex.: usuário não encontrado). No formato binary:
+    //   uint8 2 | uint32 tamanho | texto
+    void message(string_view text){
+        switch(options.format){
+            case FORMAT_TABLE:
+                buffer += '\n';
+                buffer.append(text);
+                buffer += '\n';
+                break;
+            case FORMAT_TSV:
+                buffer.append(text);
+                buffer += '\n';
+                break;
+            case FORMAT_JSONL:
+                buffer += "{\"message\": ";
+                appendJsonString(text);
+                buffer += "}\n";
+                break;
+            case FORMAT_BINARY:
+                appendRaw<uint8_t>(2);
+                appendRaw<uint32_t>(text.size());
+                buffer.append(text);
+                break;
+            default:
+                break;
+        }
+    }
+};
@@ -0,0 +1,328 @@
+// server-utils.hpp
+// trshpnd 2024
+//
+// Modo servidor: atende vários clientes ao mesmo tempo por um socket Unix ou TCP local.
+// As pesquisas rodam sobre uma cópia imutável da Database, publicada por RCU: o leitor
+// marca a época em que entrou e lê o ponteiro atual, sem trava; o publicador troca o
+// ponteiro e só libera a cópia anterior quando todos os leitores que podiam vê-la saíram.
+// As avaliações ('rate' e --follow) alteram a Database de trabalho, sob a sua trava, e uma
+// nova cópia é publicada logo depois de um 'rate' ou a cada SERVER_PUBLISH_MS se houve
+// alteração; as avaliações que chegam durante uma cópia vão juntas na próxima. O 'rate' de
+// um cliente só responde depois que a cópia com a avaliação foi publicada. A cópia só
+// duplica as estruturas que o 'rate' altera; as imutáveis são compartilhadas (ver o
+// construtor de cópia da Database).
+//
+// Protocolo: o cliente envia uma pesquisa por linha; cada resposta é uma linha com o
+// tamanho em bytes seguida do texto que o menu imprimiria.
+
+#pragma once
+
+#include "query-utils.hpp"
+#include "update-utils.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+
+using namespace std;
+
+#define SERVER_MAX_CLIENTS  256     // Conexões simultâneas (um slot de leitor RCU cada).
+#define SERVER_PUBLISH_MS   20      // Espera máxima do publicador por alterações vindas do --follow.
+#define SERVER_POLL_MS      200     // Intervalo de verificação do pedido de parada.
+#define SERVER_BACKLOG      64
+
+// Ponteiro publicado por RCU com reclamação por épocas.
+template <typename T>
+class RcuCell {
+private:
+    atomic<const T*> current{nullptr};
+    atomic<uint64_t> epoch{1};
+    atomic<uint64_t> readers[SERVER_MAX_CLIENTS] = {};     // Época de entrada do leitor; 0 fora de leitura.
+    atomic<bool> claimed[SERVER_MAX_CLIENTS] = {};
+
+public:
+    RcuCell() = default;
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+    ~RcuCell() { delete current.load(); }
+
+    // Slot de leitor para uma thread, ou -1 se todos estiverem em uso.
+    int registerReader() {
+        for (int slot = 0; slot < SERVER_MAX_CLIENTS; slot++) {
+            bool expected = false;
+            if (claimed[slot].compare_exchange_strong(expected, true)) return slot;
+        }
+        return -1;
+    }
+
+    void unregisterReader(int slot) {
+        readers[slot] = 0;
+        claimed[slot] = false;
+    }
+
+    // O ponteiro retornado vale até leave(slot).
+    const T* enter(int slot) {
+        readers[slot] = epoch.load();
+        return current.load();
+    }
+
+    void leave(int slot) { readers[slot] = 0; }
+
+    // Publica 'next' e libera a versão anterior depois que os leitores que entraram antes
+    // da troca saíram. Chamado por um único publicador.
+    void publish(const T* next) {
+        const T* previous = current.exchange(next);
+        uint64_t now = ++epoch;
+        for (auto& reader : readers) {
+            for (uint64_t e = reader.load(); e != 0 && e < now; e = reader.load()) this_thread::yield();
+        }
+        delete previous;
+    }
+};
+
+// Endereço "localhost:<porta>" ou ":<porta>" (TCP em 127.0.0.1); qualquer outro é o
+// caminho de um socket Unix.
+bool tcpPort(const string &address, int &port){
+    size_t colon = address.rfind(':');
+    if(colon == string::npos || address.find('/') != string::npos) return false;
+    if(colon > 0 && address.compare(0, colon, "localhost") != 0 && address.compare(0, colon, "127.0.0.1") != 0) return false;
+    return parseInt(string_view(address).substr(colon + 1), port);
+}
+
+// Socket conectado (listen = false) ou escutando (listen = true) em 'address'; -1 em erro.
+int openSocket(const string &address, bool listening){
+    int port, fd;
+    if(tcpPort(address, port)){
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0) return -1;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        int ok = listening ? ::bind(fd, (sockaddr*) &addr, sizeof(addr)) : connect(fd, (sockaddr*) &addr, sizeof(addr));
+        if(ok < 0 || (listening && listen(fd, SERVER_BACKLOG) < 0)){
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(address.size() >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, address.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(listening) unlink(address.c_str());
+    int ok = listening ? ::bind(fd, (sockaddr*) &addr, sizeof(addr)) : connect(fd, (sockaddr*) &addr, sizeof(addr));
+    if(ok < 0 || (listening && listen(fd, SERVER_BACKLOG) < 0)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const char* data, size_t size){
+    while(size > 0){
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if(sent <= 0) return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// Resposta do protocolo: tamanho, quebra de linha e o texto.
+bool sendResponse(int fd, const string &payload){
+    string message = to_string(payload.size()) + "\n" + payload;
+    return sendAll(fd, message.data(), message.size());
+}
+
+// Leitura bufferizada de um socket. Com 'stop', a espera é interrompida quando ele vira true.
+class SocketReader {
+private:
+    int fd;
+    const atomic<bool>* stop;
+    string buffer;
+    size_t pos = 0;
+
+    bool fill(){
+        if(pos > 0){
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        while(true){
+            if(stop){
+                pollfd p = {fd, POLLIN, 0};
+                int ready = poll(&p, 1, SERVER_POLL_MS);
+                if(*stop) return false;
+                if(ready == 0) continue;
+            }
+            char chunk[1 << 14];
+            ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+            if(got <= 0) return false;
+            buffer.append(chunk, got);
+            return true;
+        }
+    }
+
+public:
+    SocketReader(int socket, const atomic<bool>* stopFlag = nullptr) : fd(socket), stop(stopFlag) {}
+
+    bool readLine(string &line){
+        size_t end;
+        while((end = buffer.find('\n', pos)) == string::npos){
+            if(!fill()) return false;
+        }
+        line.assign(buffer, pos, end - pos);
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        pos = end + 1;
+        return true;
+    }
+
+    bool readBytes(size_t size, string &data){
+        while(buffer.size() - pos < size){
+            if(!fill()) return false;
+        }
+        data.assign(buffer, pos, size);
+        pos += size;
+        return true;
+    }
+
+    // Lê uma resposta do protocolo.
+    bool readResponse(string &payload){
+        string header;
+        int size;
+        return readLine(header) && parseInt(header, size) && size >= 0 && readBytes(size, payload);
+    }
+};
+
+class QueryServer {
+private:
+    Database &db;                   // Database de trabalho: recebe as avaliações.
+    const atomic<bool> &stop;
+    RcuCell<Database> published;
+
+    mutex publishMutex;
+    condition_variable publishedChanged;
+    condition_variable updateArrived;
+    uint64_t publishedVersion = 0;
+    atomic<int> activeClients{0};
+
+    // Copia a Database de trabalho e publica a cópia.
+    void publishCopy(){
+        Database* copy;
+        {
+            shared_lock<shared_mutex> guard(db.updateLock);
+            copy = new Database(db);
+        }
+        uint64_t version = copy->updateVersion;
+        published.publish(copy);
+
+        lock_guard<mutex> guard(publishMutex);
+        publishedVersion = version;
+        publishedChanged.notify_all();
+    }
+
+    void publisher(){
+        while(!stop){
+            {
+                unique_lock<mutex> guard(publishMutex);
+                updateArrived.wait_for(guard, chrono::milliseconds(SERVER_PUBLISH_MS), [&]{ return stop || db.updateVersion != publishedVersion; });
+            }
+            if(db.updateVersion != publishedVersion) publishCopy();
+        }
+
+        // Com a trava: um cliente que testou 'stop' antes da parada já está esperando e
+        // recebe o aviso; um que testar depois já vê 'stop'.
+        lock_guard<mutex> guard(publishMutex);
+        publishedChanged.notify_all();
+    }
+
+    void serveClient(int fd){
+        int slot = published.registerReader();
+        if(slot < 0){
+            sendResponse(fd, "Servidor cheio.\n");
+            close(fd);
+            activeClients--;
+            return;
+        }
+
+        SocketReader reader(fd, &stop);
+        QueryScratch scratch;
+        ostringstream out;
+        string line;
+
+        while(reader.readLine(line)){
+            out.str("");
+            QueryType type;
+            if(isUpdateCommand(line)){
+                type = runCommand(db, line, scratch, out);
+
+                // Responde quando a avaliação estiver visível para as pesquisas.
+                uint64_t target = db.updateVersion;
+                unique_lock<mutex> guard(publishMutex);
+                updateArrived.notify_one();
+                publishedChanged.wait(guard, [&]{ return publishedVersion >= target || stop; });
+            }
+            else{
+                const Database* snapshot = published.enter(slot);
+                type = runQuery(*snapshot, line, scratch, out);
+                published.leave(slot);
+            }
+            if(!sendResponse(fd, out.str()) || type == QUERY_QUIT) break;
+        }
+
+        published.unregisterReader(slot);
+        close(fd);
+        activeClients--;
+    }
+
+public:
+    QueryServer(Database &database, const atomic<bool> &stopFlag) : db(database), stop(stopFlag) {}
+
+    // Atende em 'address' até 'stop'. Retorna false se o endereço não puder ser aberto.
+    bool run(const string &address){
+        int listenFd = openSocket(address, true);
+        if(listenFd < 0) return false;
+
+        publishCopy();
+        thread publisherThread(&QueryServer::publisher, this);
+
+        while(!stop){
+            pollfd p = {listenFd, POLLIN, 0};
+            if(poll(&p, 1, SERVER_POLL_MS) <= 0) continue;
+
+            int fd = accept(listenFd, nullptr, nullptr);
+            if(fd < 0) continue;
+            activeClients++;
+            thread(&QueryServer::serveClient, this, fd).detach();
+        }
+
+        close(listenFd);
+        int port;
+        if(!tcpPort(address, port)) unlink(address.c_str());
+
+        while(activeClients > 0) this_thread::sleep_for(chrono::milliseconds(10));
+        publisherThread.join();
+        return true;
+    }
+};
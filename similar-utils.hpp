@@ -0,0 +1,271 @@
+// similar-utils.hpp
+// trshpnd 2024
+//
+// Tabela de co-ocorrência item a item para a pesquisa 'similar': para cada jogador X, os
+// SIMILAR_TOP_K jogadores avaliados pelos mesmos usuários, em duas ordens:
+//   SIMILAR_COMMON        mais usuários em comum com X;
+//   SIMILAR_CORRELATION   maior correlação das notas (cosseno das notas centradas na média
+//                         de cada usuário), com pelo menos SIMILAR_MIN_COMMON em comum.
+// A tabela é calculada uma vez, a partir das listas por usuário do RatingStore, e gravada
+// no snapshot; a pesquisa só lê a lista do jogador.
+//
+// Cálculo: as avaliações são transpostas para listas por jogador (usuário, nota centrada).
+// Cada jogador X é processado de forma independente, com acumuladores densos por thread:
+// para cada usuário u de X e cada jogador Y de u, soma 1 em comum[Y] e nota(u,X)*nota(u,Y)
+// em produto[Y]. Os jogadores são distribuídos entre as threads por um contador atômico.
+// O custo é a soma dos quadrados do número de avaliações de cada usuário.
+
+#pragma once
+
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+#define SIMILAR_TOP_K       30  // Vizinhos guardados por jogador, em cada ordem.
+#define SIMILAR_MIN_COMMON  5   // Usuários em comum para entrar na ordem por correlação.
+
+enum SimilarOrder {
+    SIMILAR_COMMON,
+    SIMILAR_CORRELATION,
+    SIMILAR_ORDERS
+};
+
+struct SimilarEntry {
+    int32_t  index;         // Índice do jogador no PlayerStore.
+    uint32_t common;        // Usuários que avaliaram os dois.
+    float    similarity;    // Correlação das notas, de -1 a 1.
+};
+
+// Intervalo contíguo de vizinhos de um jogador.
+struct SimilarSpan {
+    const SimilarEntry* first = nullptr;
+    const SimilarEntry* last = nullptr;
+
+    const SimilarEntry* begin() const { return first; }
+    const SimilarEntry* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// Avaliação transposta: o outro lado (jogador ou usuário) e a nota centrada.
+struct CenteredRating {
+    uint32_t index;
+    float value;
+};
+
+class SimilarityTable {
+private:
+    // Vizinhos em CSR por ordem: os de X ocupam entries[o][offsets[o][X], offsets[o][X+1]).
+    struct Table {
+        vector<uint32_t> offsets[SIMILAR_ORDERS];
+        vector<SimilarEntry> entries[SIMILAR_ORDERS];
+    };
+
+    // Não muda depois de montada, então as cópias da Database a compartilham.
+    shared_ptr<const Table> table;
+
+public:
+    // Calcula a tabela com as avaliações atuais (inclusive as atualizações) de todos os usuários.
+    void build(const PlayerStore &players, const RatingStore &ratings, int nThreads = 1){
+        size_t playerCount = players.size();
+
+        // Listas por usuário, em ordem de jogador, com notas centradas na média do usuário,
+        // e a contagem por jogador para a transposição.
+        vector<uint64_t> userOffsets(1, 0);
+        vector<CenteredRating> userEntries;
+        vector<uint64_t> itemOffsets(playerCount + 1, 0);
+        vector<Rating> scratch;
+        userOffsets.reserve(ratings.indexCount() + 1);
+        userEntries.reserve(ratings.ratingCount() + ratings.updateCount());
+
+        for(size_t user = 0; user < ratings.indexCount(); user++){
+            RatingSpan span = ratings.current(user, scratch);
+            size_t first = userEntries.size();
+            float sum = 0;
+            for(const Rating &r : span){
+                int index = players.find(r.id);
+                if(index < 0) continue;
+                userEntries.push_back({(uint32_t) index, r.rating});
+                sum += r.rating;
+                itemOffsets[index + 1]++;
+            }
+
+            // Um usuário conta uma vez por jogador: das avaliações repetidas fica a última.
+            auto segment = userEntries.begin() + first;
+            stable_sort(segment, userEntries.end(), [](const CenteredRating &a, const CenteredRating &b){ return a.index < b.index; });
+            auto kept = segment;
+            for(auto it = segment; it != userEntries.end(); it++){
+                if(it + 1 != userEntries.end() && (it + 1)->index == it->index){
+                    sum -= it->value;
+                    itemOffsets[it->index + 1]--;
+                    continue;
+                }
+                *kept++ = *it;
+            }
+            userEntries.erase(kept, userEntries.end());
+
+            float mean = userEntries.size() > first ? sum / (userEntries.size() - first) : 0;
+            for(size_t i = first; i < userEntries.size(); i++) userEntries[i].value -= mean;
+            userOffsets.push_back(userEntries.size());
+        }
+
+        // Transposição: listas por jogador, com os usuários em ordem crescente.
+        for(size_t index = 0; index < playerCount; index++) itemOffsets[index + 1] += itemOffsets[index];
+        vector<CenteredRating> itemEntries(userEntries.size());
+        vector<uint64_t> cursor(itemOffsets.begin(), itemOffsets.end() - 1);
+        vector<float> norms(playerCount, 0);
+        for(size_t user = 0; user + 1 < userOffsets.size(); user++){
+            for(uint64_t i = userOffsets[user]; i < userOffsets[user + 1]; i++){
+                const CenteredRating &r = userEntries[i];
+                itemEntries[cursor[r.index]++] = {(uint32_t) user, r.value};
+                norms[r.index] += r.value * r.value;
+            }
+        }
+        for(auto &norm : norms) norm = sqrt(norm);
+
+        // Vizinhos de cada jogador, calculados em paralelo.
+        vector<vector<SimilarEntry>> lists[SIMILAR_ORDERS];
+        for(auto &list : lists) list.resize(playerCount);
+        atomic<size_t> next(0);
+
+        auto worker = [&]{
+            // Acumuladores de cada Y lado a lado: uma linha de cache por atualização.
+            vector<pair<uint32_t, float>> sums(playerCount, {0, 0});
+            vector<uint32_t> touched;
+            vector<SimilarEntry> candidates;
+
+            for(size_t x; (x = next++) < playerCount; ){
+                touched.clear();
+                for(uint64_t i = itemOffsets[x]; i < itemOffsets[x + 1]; i++){
+                    const CenteredRating &rx = itemEntries[i];
+                    const CenteredRating* first = userEntries.data() + userOffsets[rx.index];
+                    const CenteredRating* last = userEntries.data() + userOffsets[rx.index + 1];
+                    for(const CenteredRating* ry = first; ry != last; ry++){
+                        auto &sum = sums[ry->index];
+                        if(sum.first++ == 0) touched.push_back(ry->index);
+                        sum.second += rx.value * ry->value;
+                    }
+                }
+
+                candidates.clear();
+                for(uint32_t y : touched){
+                    if(y != x){
+                        float norm = norms[x] * norms[y];
+                        candidates.push_back({(int32_t) y, sums[y].first, norm > 0 ? sums[y].second / norm : 0});
+                    }
+                    sums[y] = {0, 0};
+                }
+
+                // Empates pelo menor sofifa_id, como nos rankings.
+                auto byId = [&](const SimilarEntry &a, const SimilarEntry &b){ return players.id(a.index) < players.id(b.index); };
+                auto byCommon = [&](const SimilarEntry &a, const SimilarEntry &b){
+                    return a.common != b.common ? a.common > b.common : byId(a, b);
+                };
+                auto bySimilarity = [&](const SimilarEntry &a, const SimilarEntry &b){
+                    return a.similarity != b.similarity ? a.similarity > b.similarity : byId(a, b);
+                };
+
+                size_t k = min<size_t>(SIMILAR_TOP_K, candidates.size());
+                partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(), byCommon);
+                lists[SIMILAR_COMMON][x].assign(candidates.begin(), candidates.begin() + k);
+
+                candidates.erase(remove_if(candidates.begin(), candidates.end(),
+                                           [](const SimilarEntry &e){ return e.common < SIMILAR_MIN_COMMON; }), candidates.end());
+                k = min<size_t>(SIMILAR_TOP_K, candidates.size());
+                partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(), bySimilarity);
+                lists[SIMILAR_CORRELATION][x].assign(candidates.begin(), candidates.begin() + k);
+            }
+        };
+
+        vector<thread> workers;
+        for(int t = 1; t < nThreads; t++) workers.emplace_back(worker);
+        worker();
+        for(auto &w : workers) w.join();
+
+        auto built = make_shared<Table>();
+        for(int o = 0; o < SIMILAR_ORDERS; o++){
+            built->offsets[o].assign(1, 0);
+            for(const auto &list : lists[o]){
+                built->entries[o].insert(built->entries[o].end(), list.begin(), list.end());
+                built->offsets[o].push_back(built->entries[o].size());
+            }
+        }
+        table = std::move(built);
+    }
+
+    bool empty() const { return !table; }
+
+    size_t playerCount() const { return table ? table->offsets[0].size() - 1 : 0; }
+
+    // Vizinhos do jogador na ordem pedida (vazio se a tabela não foi montada).
+    SimilarSpan neighbors(int index, SimilarOrder order) const{
+        if(index < 0 || (size_t) index >= playerCount()) return SimilarSpan();
+        const SimilarEntry* entries = table->entries[order].data();
+        return {entries + table->offsets[order][index], entries + table->offsets[order][index + 1]};
+    }
+
+    // Formato: uint32 jogadores | por ordem: uint32 vizinhos, uint32 offsets[jogadores + 1],
+    // SimilarEntry[vizinhos].
+    void serialize(string &out) const{
+        uint32_t count = playerCount();
+        out.append((const char*) &count, sizeof(count));
+        for(int o = 0; o < SIMILAR_ORDERS && table; o++){
+            uint32_t entries = table->entries[o].size();
+            out.append((const char*) &entries, sizeof(entries));
+            out.append((const char*) table->offsets[o].data(), table->offsets[o].size() * sizeof(uint32_t));
+            out.append((const char*) table->entries[o].data(), entries * sizeof(SimilarEntry));
+        }
+    }
+
+    // Lê a tabela gravada por serialize. Retorna false se 'size' não corresponder ao conteúdo.
+    bool deserialize(const char* in, size_t size){
+        const char* end = in + size;
+        uint32_t count;
+        if(size < sizeof(count)) return false;
+        memcpy(&count, in, sizeof(count));
+        in += sizeof(count);
+
+        if(count == 0){
+            table.reset();
+            return true;
+        }
+
+        auto loaded = make_shared<Table>();
+        for(int o = 0; o < SIMILAR_ORDERS; o++){
+            uint32_t entries;
+            if((size_t) (end - in) < sizeof(entries)) return false;
+            memcpy(&entries, in, sizeof(entries));
+            in += sizeof(entries);
+
+            size_t bytes = (count + 1) * sizeof(uint32_t) + (size_t) entries * sizeof(SimilarEntry);
+            if((size_t) (end - in) < bytes) return false;
+            loaded->offsets[o].resize(count + 1);
+            memcpy(loaded->offsets[o].data(), in, (count + 1) * sizeof(uint32_t));
+            in += (count + 1) * sizeof(uint32_t);
+            loaded->entries[o].resize(entries);
+            memcpy(loaded->entries[o].data(), in, entries * sizeof(SimilarEntry));
+            in += entries * sizeof(SimilarEntry);
+        }
+        table = std::move(loaded);
+        return true;
+    }
+
+    size_t memoryBytes() const{
+        size_t bytes = 0;
+        for(int o = 0; o < SIMILAR_ORDERS && table; o++){
+            bytes += table->offsets[o].capacity() * sizeof(uint32_t) + table->entries[o].capacity() * sizeof(SimilarEntry);
+        }
+        return bytes;
+    }
+};
@@ -0,0 +1,303 @@
+// snapshot-utils.hpp
+// trshpnd 2024
+//
+// Snapshot binário das estruturas construídas a partir dos CSVs (tabela de jogadores,
+// avaliações dos usuários, trie de nomes, índice de tags e tabela de similares). O arquivo é composto por um
+// cabeçalho, uma tabela de seções e as seções propriamente ditas; todas as referências
+// internas são offsets/índices, nunca ponteiros, então o arquivo é lido via mmap.
+//
+// Layout:
+//   SnapshotHeader | SnapshotSection[sectionCount] | seções (alinhadas a 8 bytes)
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "hash-utils.hpp"
+#include "trie-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "tag-utils.hpp"
+#include "similar-utils.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#define SNAPSHOT_MAGIC      "CPDSNAP"
+#define SNAPSHOT_VERSION    5
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+enum SnapshotSectionKind : uint32_t {
+    SECTION_PLAYERS = 1,    // SnapshotPlayer[]
+    SECTION_STRINGS,        // Textos dos jogadores, referenciados por offset/tamanho.
+    SECTION_USERS,          // SnapshotUser[]
+    SECTION_RATINGS,        // Rating[] de todos os usuários (entries do RatingStore).
+    SECTION_NAME_TRIE,      // SnapshotTrieHeader + TrieNode[] + rótulos + uint32_t[] + int[] (ver Trie::flatten)
+    SECTION_TAG_TRIE,       // Dicionário de tags: tag -> tag id.
+    SECTION_RATING_OFFSETS, // uint64_t[userCount + 1] (offsets do RatingStore).
+    SECTION_TAG_POSTINGS,   // uint32_t tagCount + PostingList serializadas (ver PostingList::serialize).
+    SECTION_SIMILAR         // Tabela de co-ocorrência (ver SimilarityTable::serialize).
+};
+
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;         // Snapshots são gravados na ordem de bytes do host.
+    uint64_t fileSize;
+    uint64_t checksum;          // Calculado sobre todo o arquivo após o cabeçalho.
+    uint32_t sectionCount;
+    uint32_t playerCount;
+    uint32_t userCount;
+    uint32_t reserved;
+};
+
+struct SnapshotSection {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;            // A partir do início do arquivo.
+    uint64_t size;
+};
+
+// Campos de texto: short_name, long_name, player_positions, nationality, club_name, league_name.
+struct SnapshotPlayer {
+    int32_t  id;
+    int32_t  total_ratings;
+    float    rating;
+    uint32_t text[6][2];        // {offset, tamanho} na seção de strings.
+};
+
+struct SnapshotUser {
+    int32_t  id;
+    int32_t  index;             // Índice denso no RatingStore.
+};
+
+struct SnapshotTrieHeader {
+    uint32_t nodeCount;
+    uint32_t labelBytes;        // Rótulos, completados com zeros até múltiplo de 4.
+    uint32_t valueLists;
+    uint32_t valueCount;
+};
+
+// Checksum de 64 bits processando 8 bytes por vez. 'size' deve ser múltiplo de 8,
+// o que é garantido pelo alinhamento das seções.
+uint64_t snapshotChecksum(uint64_t hash, const char* data, size_t size){
+    for(size_t i = 0; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash ^= word * 0x9E3779B97F4A7C15ULL;
+        hash = ((hash << 31) | (hash >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+    }
+    return hash;
+}
+
+// Conteúdo de uma seção antes da gravação.
+struct SnapshotBlob {
+    uint32_t kind;
+    string data;
+
+    void append(const void* src, size_t size){ data.append((const char*) src, size); }
+};
+
+// Trie no layout da seção: SnapshotTrieHeader + nodos + rótulos + offsets + valores.
+void appendTrie(SnapshotBlob &blob, const Trie &trie){
+    vector<TrieNode> nodes;
+    string labels;
+    vector<uint32_t> valueOffsets;
+    vector<int> values;
+    trie.flatten(nodes, labels, valueOffsets, values);
+
+    SnapshotTrieHeader oTrie = {(uint32_t) nodes.size(), (uint32_t) labels.size(), (uint32_t) valueOffsets.size() - 1, (uint32_t) values.size()};
+    labels.resize((labels.size() + 3) & ~size_t(3), '\0');
+
+    blob.append(&oTrie, sizeof(oTrie));
+    blob.append(nodes.data(), nodes.size() * sizeof(TrieNode));
+    blob.append(labels.data(), labels.size());
+    blob.append(valueOffsets.data(), valueOffsets.size() * sizeof(uint32_t));
+    blob.append(values.data(), values.size() * sizeof(int));
+}
+
+void readTrie(const char* section, Trie &trie){
+    const SnapshotTrieHeader* oTrie = (const SnapshotTrieHeader*) section;
+    const TrieNode* nodes = (const TrieNode*) (section + sizeof(SnapshotTrieHeader));
+    const char* labels = (const char*) (nodes + oTrie->nodeCount);
+    const uint32_t* valueOffsets = (const uint32_t*) (labels + ((oTrie->labelBytes + 3) & ~3u));
+    const int* values = (const int*) (valueOffsets + oTrie->valueLists + 1);
+
+    trie.unflatten(nodes, oTrie->nodeCount, labels, oTrie->labelBytes, valueOffsets, oTrie->valueLists, values);
+}
+
+// Grava o snapshot. Retorna false se o arquivo não puder ser escrito.
+bool saveSnapshot(const string &path, const PlayerStore &players, HashTable<User> &usersHash, const RatingStore &ratingStore, const Trie &playerNames, const TagIndex &tagIndex,
+                  const SimilarityTable &similar){
+    vector<SnapshotBlob> blobs(9);
+
+    // Jogadores e textos.
+    blobs[0].kind = SECTION_PLAYERS;
+    blobs[1].kind = SECTION_STRINGS;
+    for(int index = 0; index < (int) players.size(); index++){
+        SnapshotPlayer oPlayer = {players.id(index), players.totalRatings(index), players.rating(index), {}};
+
+        for(int f = 0; f < PLAYER_TEXT_FIELDS; f++){
+            string_view text = players.text(index, (PlayerField) f);
+            oPlayer.text[f][0] = blobs[1].data.size();
+            oPlayer.text[f][1] = text.size();
+            blobs[1].data += text;
+        }
+        blobs[0].append(&oPlayer, sizeof(oPlayer));
+    }
+
+    // Usuários e o RatingStore, no mesmo layout CSR da memória.
+    blobs[2].kind = SECTION_USERS;
+    hashForEach(usersHash, [&](const User &user){
+        SnapshotUser oUser = {user.id, user.index};
+        blobs[2].append(&oUser, sizeof(oUser));
+    });
+
+    blobs[3].kind = SECTION_RATINGS;
+    blobs[3].append(ratingStore.entries(), ratingStore.ratingCount() * sizeof(Rating));
+    blobs[6].kind = SECTION_RATING_OFFSETS;
+    blobs[6].append(ratingStore.offsets(), (ratingStore.userCount() + 1) * sizeof(uint64_t));
+
+    // Trie de nomes e índice de tags.
+    blobs[4].kind = SECTION_NAME_TRIE;
+    appendTrie(blobs[4], playerNames);
+    blobs[5].kind = SECTION_TAG_TRIE;
+    appendTrie(blobs[5], tagIndex.tagDictionary());
+
+    blobs[7].kind = SECTION_TAG_POSTINGS;
+    uint32_t tagCount = tagIndex.tagCount();
+    blobs[7].append(&tagCount, sizeof(tagCount));
+    for(const auto &list : tagIndex.tagPostings()) list.serialize(blobs[7].data);
+
+    blobs[8].kind = SECTION_SIMILAR;
+    similar.serialize(blobs[8].data);
+
+    // Tabela de seções: cada seção começa alinhada a 8 bytes.
+    vector<SnapshotSection> sections;
+    uint64_t offset = sizeof(SnapshotHeader) + blobs.size() * sizeof(SnapshotSection);
+    for(auto &blob : blobs){
+        sections.push_back({blob.kind, 0, offset, blob.data.size()});
+        blob.data.resize((blob.data.size() + 7) & ~size_t(7), '\0');
+        offset += blob.data.size();
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.fileSize = offset;
+    header.sectionCount = sections.size();
+    header.playerCount = players.size();
+    header.userCount = usersHash.count;
+
+    header.checksum = snapshotChecksum(0, (const char*) sections.data(), sections.size() * sizeof(SnapshotSection));
+    for(const auto &blob : blobs) header.checksum = snapshotChecksum(header.checksum, blob.data.data(), blob.data.size());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) sections.data(), sections.size() * sizeof(SnapshotSection));
+    for(const auto &blob : blobs) out.write(blob.data.data(), blob.data.size());
+
+    return (bool) out;
+}
+
+// Localiza uma seção no arquivo mapeado. Retorna nullptr se ausente.
+const char* snapshotSection(const MappedFile &file, uint32_t kind, uint64_t &size){
+    const SnapshotHeader* header = (const SnapshotHeader*) file.data();
+    const SnapshotSection* sections = (const SnapshotSection*) (file.data() + sizeof(SnapshotHeader));
+
+    for(uint32_t i = 0; i < header->sectionCount; i++){
+        if(sections[i].kind == kind && sections[i].offset + sections[i].size <= file.size()){
+            size = sections[i].size;
+            return file.data() + sections[i].offset;
+        }
+    }
+    size = 0;
+    return nullptr;
+}
+
+// Carrega o snapshot, substituindo o conteúdo das estruturas. Retorna false (sem
+// alterar nada) se o arquivo não existir, for de outra versão ou estiver corrompido.
+// As avaliações não são copiadas: o RatingStore passa a apontar para o arquivo mapeado.
+bool loadSnapshot(const string &path, PlayerStore &playerStore, HashTable<User> &usersHash, RatingStore &ratingStore, Trie &playerNames, TagIndex &tagIndex,
+                  SimilarityTable &similar){
+    auto mapping = make_shared<const MappedFile>(path);
+    const MappedFile &file = *mapping;
+
+    if(!file.isOpen() || file.size() < sizeof(SnapshotHeader)){
+        cout << "Snapshot " << path << " inexistente ou vazio. ";
+        return false;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*) file.data();
+    uint64_t tableBytes = (uint64_t) header->sectionCount * sizeof(SnapshotSection);
+
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header->byteOrder != SNAPSHOT_BYTE_ORDER){
+        cout << "Arquivo " << path << " nao e um snapshot valido. ";
+        return false;
+    }
+    if(header->version != SNAPSHOT_VERSION){
+        cout << "Snapshot " << path << " na versao " << header->version << ", esperada " << SNAPSHOT_VERSION << ". ";
+        return false;
+    }
+    if(header->fileSize != file.size() || sizeof(SnapshotHeader) + tableBytes > file.size()
+       || snapshotChecksum(0, file.data() + sizeof(SnapshotHeader), file.size() - sizeof(SnapshotHeader)) != header->checksum){
+        cout << "Snapshot " << path << " corrompido. ";
+        return false;
+    }
+
+    uint64_t playersSize, stringsSize, usersSize, ratingsSize, offsetsSize, trieSize[2], postingsSize, similarSize;
+    const SnapshotPlayer* players = (const SnapshotPlayer*) snapshotSection(file, SECTION_PLAYERS, playersSize);
+    const char* strings = snapshotSection(file, SECTION_STRINGS, stringsSize);
+    const SnapshotUser* users = (const SnapshotUser*) snapshotSection(file, SECTION_USERS, usersSize);
+    const Rating* ratings = (const Rating*) snapshotSection(file, SECTION_RATINGS, ratingsSize);
+    const uint64_t* offsets = (const uint64_t*) snapshotSection(file, SECTION_RATING_OFFSETS, offsetsSize);
+    const char* tries[2] = {snapshotSection(file, SECTION_NAME_TRIE, trieSize[0]),
+                            snapshotSection(file, SECTION_TAG_TRIE, trieSize[1])};
+    const char* postings = snapshotSection(file, SECTION_TAG_POSTINGS, postingsSize);
+    const char* similarSection = snapshotSection(file, SECTION_SIMILAR, similarSize);
+
+    SimilarityTable similarTable;
+    if(!players || !strings || !users || !ratings || !offsets || offsetsSize < sizeof(uint64_t) || !tries[0] || !tries[1] || !postings
+       || !similarSection || !similarTable.deserialize(similarSection, similarSize)){
+        cout << "Snapshot " << path << " incompleto. ";
+        return false;
+    }
+
+    // Jogadores.
+    playerStore = PlayerStore(header->playerCount);
+    for(size_t i = 0; i < playersSize / sizeof(SnapshotPlayer); i++){
+        string_view text[PLAYER_TEXT_FIELDS];
+        for(int f = 0; f < PLAYER_TEXT_FIELDS; f++) text[f] = string_view(strings + players[i].text[f][0], players[i].text[f][1]);
+
+        playerStore.add(players[i].id, text, players[i].total_ratings, players[i].rating);
+    }
+
+    // Usuários.
+    usersHash = HashTable<User>(header->userCount);
+    for(size_t i = 0; i < usersSize / sizeof(SnapshotUser); i++){
+        User oUser;
+        oUser.id = users[i].id;
+        oUser.index = users[i].index;
+        hashInsert(usersHash, oUser);
+    }
+
+    ratingStore.attach(mapping, offsets, ratings, offsetsSize / sizeof(uint64_t) - 1);
+
+    // Trie de nomes e índice de tags.
+    readTrie(tries[0], playerNames);
+
+    Trie tagDictionary;
+    readTrie(tries[1], tagDictionary);
+
+    uint32_t tagCount;
+    memcpy(&tagCount, postings, sizeof(tagCount));
+    vector<PostingList> tagPostings(tagCount);
+    const char* cursor = postings + sizeof(tagCount);
+    for(auto &list : tagPostings) cursor = list.deserialize(cursor);
+    tagIndex.assign(std::move(tagDictionary), std::move(tagPostings));
+
+    similar = std::move(similarTable);
+
+    return true;
+}
@@ -0,0 +1,117 @@
+// sort-utils.hpp
+// trshpnd 2024
+//
+// Ordenação de pares (chave, índice). As consultas não movem Players: montam uma chave
+// inteira de 64 bits por resultado, ordenam os pares e só então imprimem os Players na
+// ordem dos índices. A ordenação é um radix sort LSD (estável) de 8 bits por passada;
+// passadas em que todos os elementos têm o mesmo byte são puladas, então chaves pequenas
+// custam poucas passadas. Vetores pequenos usam insertion sort.
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+#define SORT_SMALL      64      // Até este tamanho, insertion sort.
+#define SORT_RADIX_BITS 8
+#define SORT_BUCKETS    (1 << SORT_RADIX_BITS)
+
+struct SortItem {
+    uint64_t key;
+    uint32_t index;
+};
+
+// Buffers reaproveitados entre ordenações.
+struct SortScratch {
+    vector<SortItem> items;
+    vector<SortItem> buffer;
+    vector<int> ids;
+};
+
+// Converte um float em uma chave inteira com a mesma ordem (crescente).
+inline uint32_t floatKey(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// Ordem decrescente do float.
+inline uint32_t floatKeyDesc(float value) {
+    return ~floatKey(value);
+}
+
+// Ordem crescente do int.
+inline uint32_t intKey(int value) {
+    return (uint32_t) value ^ 0x80000000u;
+}
+
+// Chave dos rankings: maior nota primeiro; empate pelo menor id.
+inline uint64_t rankKey(float rating, int id) {
+    return ((uint64_t) floatKeyDesc(rating) << 32) | intKey(id);
+}
+
+inline void insertionSort(SortItem* items, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        SortItem item = items[i];
+        size_t j = i;
+        while (j > 0 && items[j - 1].key > item.key) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+// Ordena 'items' por chave crescente, preservando a ordem de chaves iguais.
+void radixSort(vector<SortItem>& items, vector<SortItem>& buffer) {
+    size_t n = items.size();
+    if (n <= SORT_SMALL) {
+        insertionSort(items.data(), n);
+        return;
+    }
+
+    // Histogramas de todos os bytes em uma única leitura.
+    static const int PASSES = 64 / SORT_RADIX_BITS;
+    size_t counts[PASSES][SORT_BUCKETS] = {};
+    for (const auto& item : items) {
+        for (int pass = 0; pass < PASSES; pass++) counts[pass][(item.key >> (pass * SORT_RADIX_BITS)) & (SORT_BUCKETS - 1)]++;
+    }
+
+    buffer.resize(n);
+    SortItem* from = items.data();
+    SortItem* to = buffer.data();
+
+    for (int pass = 0; pass < PASSES; pass++) {
+        size_t* count = counts[pass];
+        int shift = pass * SORT_RADIX_BITS;
+
+        // Todos no mesmo bucket: a passada não muda nada.
+        if (count[(from[0].key >> shift) & (SORT_BUCKETS - 1)] == n) continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < SORT_BUCKETS; b++) {
+            size_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) to[count[(from[i].key >> shift) & (SORT_BUCKETS - 1)]++] = from[i];
+        swap(from, to);
+    }
+
+    if (from != items.data()) memcpy(items.data(), from, n * sizeof(SortItem));
+}
+
+// Reordena 'ids' por keyOf(id), crescente e estável.
+template <typename KeyOf>
+void sortByKey(vector<int>& ids, KeyOf keyOf, SortScratch& scratch) {
+    scratch.items.clear();
+    for (size_t i = 0; i < ids.size(); i++) scratch.items.push_back({keyOf(ids[i]), (uint32_t) i});
+    radixSort(scratch.items, scratch.buffer);
+
+    scratch.ids.clear();
+    for (const auto& item : scratch.items) scratch.ids.push_back(ids[item.index]);
+    ids.swap(scratch.ids);
+}
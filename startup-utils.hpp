@@ -0,0 +1,80 @@
+// startup-utils.hpp
+// trshpnd 2024
+//
+// Carga progressiva do menu interativo. Jogadores, trie de nomes e índices de tags, de
+// trigramas e de filtros não dependem das avaliações: são carregados antes do menu, que abre na etapa
+// LOAD_PLAYERS. O arquivo de ratings é lido por uma thread em segundo plano, sobre cópias
+// das estruturas, e publicado em duas etapas, cada uma sob a trava exclusiva da Database:
+//   LOAD_TOTALS     ao fim da primeira passada: médias dos jogadores e rankings;
+//   LOAD_COMPLETE   ao fim da segunda: avaliações de cada usuário, tabela de similares (se
+//                   pedida) e log de avaliações.
+// As pesquisas esperam só a etapa de que precisam (requiredStage); até LOAD_TOTALS,
+// 'player', 'contains' e 'tags' saem com a marca de resultado parcial.
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "query-utils.hpp"
+#include "load-utils.hpp"
+#include "update-utils.hpp"
+#include "stats-utils.hpp"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+
+using namespace std;
+
+// Corpo da thread de carga. 'db' deve estar em LOAD_PLAYERS, com os jogadores carregados.
+// Com 'buildSimilar', calcula também a tabela de similares.
+void loadRatingsInBackground(Database &db, const string &rating_dir, int nThreads, const string &ratingLogPath, bool buildSimilar){
+    MappedFile g(rating_dir);
+    db.loadTotal = 2 * g.size();
+
+    // Até LOAD_COMPLETE nada altera os jogadores e usuários da Database, então as cópias
+    // dispensam a trava.
+    PlayerStore players(db.players);
+    HashTable<User> users(db.users);
+    RatingStore ratings;
+    vector<PhaseTiming> phases;
+
+    auto publishTotals = [&]{
+        PlayerStore averages(players);
+        timePhase(&phases, "medias", [&]{ computeAverages(averages); return (size_t) 0; });
+        {
+            unique_lock<shared_mutex> guard(db.updateLock);
+            db.players = std::move(averages);
+            timePhase(&phases, "rankings", [&]{ buildRankings(db); return (size_t) 0; });
+        }
+        setLoadStage(db, LOAD_TOTALS);
+    };
+
+    timePhase(&phases, rating_dir, [&]{
+        loadRatings(players, users, ratings, g, nThreads, &db.loadDone, publishTotals);
+        return ratings.ratingCount();
+    });
+
+    // Calculada fora da trava, sobre as cópias, com as avaliações do arquivo (como na carga normal).
+    SimilarityTable similar;
+    if(buildSimilar){
+        timePhase(&phases, "tabela de similares", [&]{ similar.build(players, ratings, nThreads); return ratings.ratingCount(); });
+    }
+
+    {
+        unique_lock<shared_mutex> guard(db.updateLock);
+        db.users = std::move(users);
+        db.userRatings = std::move(ratings);
+        db.similar = std::move(similar);
+
+        // O log muda as médias: os rankings são refeitos.
+        if(!ratingLogPath.empty()){
+            timePhase(&phases, ratingLogPath, [&]{ return openRatingLog(db, ratingLogPath); });
+            timePhase(&phases, "rankings", [&]{ buildRankings(db); return (size_t) 0; });
+        }
+        db.phases.insert(db.phases.end(), phases.begin(), phases.end());
+    }
+    setLoadStage(db, LOAD_COMPLETE);
+}
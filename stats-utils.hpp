@@ -0,0 +1,98 @@
+// stats-utils.hpp
+// trshpnd 2024
+//
+// Instrumentação: tempo e volume de cada fase da carga, e contadores de latência das
+// pesquisas. Os contadores são atômicos, então podem ser atualizados por várias threads
+// (modo batch) sem trava. A latência vai para um histograma com 4 faixas por potência de
+// dois de nanossegundos; os percentis são o limite superior da faixa (erro de até 25%).
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+#define LATENCY_BUCKETS 256
+
+struct PhaseTiming{
+    string name;
+    double seconds;
+    size_t rows;        // Linhas lidas (0 se a fase não lê arquivo).
+};
+
+// Executa fn() (que retorna o número de linhas processadas) e registra a fase.
+template <typename Function>
+void timePhase(vector<PhaseTiming> *phases, const string &name, Function fn){
+    auto start = chrono::steady_clock::now();
+    size_t rows = fn();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(phases) phases->push_back({name, seconds, rows});
+}
+
+inline int latencyBucket(uint64_t ns){
+    if(ns < 4) return ns;
+    int k = 63 - __builtin_clzll(ns);
+    return 4 * (k - 1) + ((ns >> (k - 2)) & 3);
+}
+
+// Limite superior (exclusivo) da faixa, em nanossegundos.
+inline double latencyBucketLimit(int bucket){
+    if(bucket < 4) return bucket + 1;
+    int k = bucket / 4 + 1;
+    return (double) (5 + bucket % 4) * (double) (1ULL << (k - 2));
+}
+
+struct QueryCounters{
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> totalNs{0};
+    atomic<uint64_t> maxNs{0};
+    atomic<uint64_t> buckets[LATENCY_BUCKETS] = {};
+
+    void record(uint64_t ns){
+        count.fetch_add(1, memory_order_relaxed);
+        totalNs.fetch_add(ns, memory_order_relaxed);
+        buckets[latencyBucket(ns)].fetch_add(1, memory_order_relaxed);
+
+        uint64_t current = maxNs.load(memory_order_relaxed);
+        while(ns > current && !maxNs.compare_exchange_weak(current, ns, memory_order_relaxed));
+    }
+
+    // Percentil 'p' (0 a 1) em microssegundos.
+    double percentileUs(double p) const{
+        uint64_t total = count.load(memory_order_relaxed);
+        if(total == 0) return 0;
+
+        uint64_t target = (uint64_t) (p * total), seen = 0;
+        for(int b = 0; b < LATENCY_BUCKETS; b++){
+            seen += buckets[b].load(memory_order_relaxed);
+            if(seen > target) return min(latencyBucketLimit(b), (double) maxNs.load(memory_order_relaxed)) / 1000.0;
+        }
+        return maxNs.load(memory_order_relaxed) / 1000.0;
+    }
+
+    double meanUs() const{
+        uint64_t total = count.load(memory_order_relaxed);
+        return total ? totalNs.load(memory_order_relaxed) / 1000.0 / total : 0;
+    }
+};
+
+// Memória residente do processo em bytes (Linux; 0 se indisponível).
+size_t residentBytes(){
+    ifstream status("/proc/self/status");
+    string key;
+    while(status >> key){
+        if(key == "VmRSS:"){
+            size_t kb = 0;
+            status >> kb;
+            return kb * 1024;
+        }
+        status.ignore(1 << 16, '\n');
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+// tag-utils.hpp
+// trshpnd 2024
+//
+// Índice de tags: uma trie leva cada tag (normalizada) ao seu id, e cada id tem a
+// PostingList comprimida com os sofifa_ids dos jogadores que receberam a tag. Na carga
+// (buildTagsTrie), um StringDictionary dá a cada tag distinta um id denso sem percorrer a
+// trie por linha. O índice não muda depois de montado, então as cópias o compartilham.
+
+#pragma once
+
+#include "trie-utils.hpp"
+#include "posting-utils.hpp"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+class TagIndex {
+private:
+    struct Data {
+        Trie dictionary;                // tag -> tag id (único valor de cada palavra).
+        vector<PostingList> postings;   // Indexado pelo tag id.
+    };
+    shared_ptr<const Data> data = make_shared<const Data>();
+
+public:
+    // Monta o índice a partir das tags ('tags[id]', já normalizadas) e dos pares
+    // (tag id << 32 | sofifa_id), ordenados e sem repetições.
+    void build(const vector<string_view>& tags, const vector<uint64_t>& pairs) {
+        auto built = make_shared<Data>();
+        built->postings.reserve(tags.size());
+
+        vector<int> ids;
+        size_t p = 0;
+        for (uint32_t tag = 0; tag < tags.size(); tag++) {
+            ids.clear();
+            for (; p < pairs.size() && (uint32_t) (pairs[p] >> 32) == tag; p++) ids.push_back((int) (uint32_t) pairs[p]);
+
+            built->dictionary.insert(tags[tag], tag);
+            built->postings.emplace_back(ids);
+        }
+        built->dictionary.compact();
+        data = std::move(built);
+    }
+
+    // Lista da tag, ou nullptr se a tag não existir.
+    const PostingList* find(string_view tag, vector<int>& scratch) const {
+        if (!data->dictionary.search(tag, scratch) || scratch.empty()) return nullptr;
+        return &data->postings[scratch[0]];
+    }
+
+    // Jogadores que têm todas as tags, em ordem crescente de sofifa_id.
+    void intersect(const vector<string>& tags, IntersectScratch& scratch, vector<int>& result) const {
+        result.clear();
+        scratch.lists.clear();
+        for (const auto& tag : tags) {
+            const PostingList* list = find(tag, result);
+            if (!list) {
+                result.clear();
+                return;
+            }
+            scratch.lists.push_back(list);
+        }
+        intersectPostings(scratch, result);
+    }
+
+    size_t tagCount() const { return data->postings.size(); }
+
+    size_t memoryBytes() const {
+        size_t bytes = data->dictionary.memoryBytes();
+        for (const auto& list : data->postings) bytes += sizeof(PostingList) + list.memoryBytes();
+        return bytes;
+    }
+
+    const Trie& tagDictionary() const { return data->dictionary; }
+    const vector<PostingList>& tagPostings() const { return data->postings; }
+
+    // Usado pelo snapshot.
+    void assign(Trie&& tagDictionary, vector<PostingList>&& tagPostings) {
+        auto loaded = make_shared<Data>();
+        loaded->dictionary = std::move(tagDictionary);
+        loaded->postings = std::move(tagPostings);
+        data = std::move(loaded);
+    }
+};
@@ -1,21 +1,38 @@
 // trie-utils.hpp
 // trshpnd 2024
+//
+// Trie radix (Patricia): cadeias de nodos com um único filho são comprimidas em uma
+// aresta rotulada por uma substring. Os nodos ficam em um vetor (arena) e se referenciam
+// por índice; os rótulos ficam todos em uma única string. Os filhos de um nodo formam uma
+// lista encadeada (firstChild/nextSibling) em ordem crescente do primeiro byte do rótulo.
+//
+// Opcionalmente cada nodo guarda os K melhores valores da sua subárvore segundo um
+// critério externo (buildRanking), para consultas de prefixo com limite sem percorrer
+// a subárvore inteira.
+
+#pragma once
 
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
 
-class TrieNode {
-public:
-    std::vector<TrieNode*> children;
-    bool isEndOfWord;
-    std::vector<int> values; // Vetor para armazenar os valores associados ao nodo folha.
+using namespace std;
+
+#define TRIE_NONE 0xFFFFFFFFu
 
-    TrieNode() : children(128, nullptr), isEndOfWord(false) {}
+struct TrieNode {
+    uint32_t labelOffset;   // Rótulo da aresta que chega ao nodo: labels[labelOffset, +labelLength).
+    uint32_t labelLength;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t valuesIndex;   // Índice em 'values'; TRIE_NONE se nenhuma palavra termina aqui.
 };
 
-string toLowerCase(const string& str) {
-    string lowerStr = str;
+string toLowerCase(string_view str) {
+    string lowerStr(str);
     transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(), ::tolower);
     return lowerStr;
 }
@@ -28,86 +45,347 @@ string toUpperCase(const std::string& str) {
 
 class Trie {
 private:
-    TrieNode* root;
+    vector<TrieNode> nodes;         // nodes[0] é a raiz (rótulo vazio).
+    string labels;
+    vector<vector<int>> values;     // Valores associados a cada palavra.
+
+    // Ranking por nodo: os melhores valores da subárvore do nodo n ficam em
+    // rankIds[rankStart[n], rankStart[n+1]), do melhor para o pior.
+    vector<uint32_t> rankStart;
+    vector<int> rankIds;
+
+    uint32_t newNode(uint32_t labelOffset, uint32_t labelLength) {
+        nodes.push_back({labelOffset, labelLength, TRIE_NONE, TRIE_NONE, TRIE_NONE});
+        return nodes.size() - 1;
+    }
+
+    unsigned char firstByte(uint32_t node) const {
+        return labels[nodes[node].labelOffset];
+    }
+
+    // Desce pela trie consumindo 'key'. Retorna o nodo alcançado e, em 'consumed', quantos
+    // bytes do rótulo desse nodo foram usados (menos que labelLength se 'key' acaba no meio
+    // da aresta). Retorna TRIE_NONE se 'key' não estiver na trie.
+    uint32_t descend(string_view key, uint32_t& consumed) const {
+        uint32_t node = 0;
+        size_t i = 0;
+        consumed = 0;
+
+        while (i < key.size()) {
+            uint32_t child = nodes[node].firstChild;
+            while (child != TRIE_NONE && firstByte(child) < (unsigned char) key[i]) child = nodes[child].nextSibling;
+            if (child == TRIE_NONE || firstByte(child) != (unsigned char) key[i]) return TRIE_NONE;
 
-    // Coleciona valores, usado na função de pesquisa por prefixo. Resultado 
+            const TrieNode& edge = nodes[child];
+            uint32_t length = min<size_t>(edge.labelLength, key.size() - i);
+            if (labels.compare(edge.labelOffset, length, key.data() + i, length) != 0) return TRIE_NONE;
+
+            node = child;
+            consumed = length;
+            i += length;
+        }
+        if (node == 0) consumed = 0;
+        return node;
+    }
+
+    // Coleciona valores, usado na função de pesquisa por prefixo. Resultado
     // retornado por referência no vetor.
-    void collectValues(TrieNode* node, vector<int>& result) {
+    void collectValues(uint32_t node, vector<int>& result) const {
         // Se for o nodo final, insere resultados no vetor.
-        if (node->isEndOfWord) {
-            result.insert(result.end(), node->values.begin(), node->values.end());
+        if (nodes[node].valuesIndex != TRIE_NONE) {
+            const vector<int>& nodeValues = values[nodes[node].valuesIndex];
+            result.insert(result.end(), nodeValues.begin(), nodeValues.end());
         }
         // Para cada nodo filho, coletar os valores. Chamada recursiva.
-        for (TrieNode* child : node->children) {
-            if (child != nullptr) {
-                collectValues(child, result);
-            }
+        for (uint32_t child = nodes[node].firstChild; child != TRIE_NONE; child = nodes[child].nextSibling) {
+            collectValues(child, result);
+        }
+    }
+
+    // Candidatos ao ranking de um nodo: seus próprios valores e o ranking de cada filho.
+    template <typename Better>
+    void rankCandidates(uint32_t node, size_t k, Better better, vector<int>& candidates) const {
+        candidates.clear();
+        if (nodes[node].valuesIndex != TRIE_NONE) {
+            const vector<int>& nodeValues = values[nodes[node].valuesIndex];
+            candidates.insert(candidates.end(), nodeValues.begin(), nodeValues.end());
+        }
+        for (uint32_t child = nodes[node].firstChild; child != TRIE_NONE; child = nodes[child].nextSibling) {
+            candidates.insert(candidates.end(), rankIds.begin() + rankStart[child], rankIds.begin() + rankStart[child + 1]);
         }
+        size_t keep = min(k, candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), better);
+        candidates.resize(keep);
+    }
+
+    // Calcula o ranking da subárvore em pós-ordem, guardando-o temporariamente em 'lists'.
+    template <typename Better>
+    void rankSubtree(uint32_t node, size_t k, Better better, vector<vector<int>>& lists) {
+        vector<int> candidates;
+        if (nodes[node].valuesIndex != TRIE_NONE) candidates = values[nodes[node].valuesIndex];
+
+        for (uint32_t child = nodes[node].firstChild; child != TRIE_NONE; child = nodes[child].nextSibling) {
+            rankSubtree(child, k, better, lists);
+            candidates.insert(candidates.end(), lists[child].begin(), lists[child].end());
+        }
+        size_t keep = min(k, candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), better);
+        candidates.resize(keep);
+        lists[node] = std::move(candidates);
+    }
+
+    // Copia a subárvore de 'node' em pré-ordem para os vetores de saída (ver compact()).
+    uint32_t copySubtree(uint32_t node, vector<TrieNode>& outNodes, string& outLabels, vector<vector<int>>& outValues) {
+        uint32_t index = outNodes.size();
+        outNodes.push_back(nodes[node]);
+        outNodes[index].labelOffset = outLabels.size();
+        outNodes[index].firstChild = TRIE_NONE;
+        outNodes[index].nextSibling = TRIE_NONE;
+        outLabels.append(labels, nodes[node].labelOffset, nodes[node].labelLength);
+
+        if (nodes[node].valuesIndex != TRIE_NONE) {
+            outNodes[index].valuesIndex = outValues.size();
+            outValues.push_back(std::move(values[nodes[node].valuesIndex]));
+        }
+
+        uint32_t previous = TRIE_NONE;
+        for (uint32_t child = nodes[node].firstChild; child != TRIE_NONE; child = nodes[child].nextSibling) {
+            uint32_t copy = copySubtree(child, outNodes, outLabels, outValues);
+            if (previous == TRIE_NONE) outNodes[index].firstChild = copy;
+            else outNodes[previous].nextSibling = copy;
+            previous = copy;
+        }
+        return index;
+    }
+
+    template <typename F>
+    void forEachWord(uint32_t node, string& word, F& fn) const {
+        size_t length = word.size();
+        word.append(labels, nodes[node].labelOffset, nodes[node].labelLength);
+        if (nodes[node].valuesIndex != TRIE_NONE) fn(word, values[nodes[node].valuesIndex]);
+        for (uint32_t child = nodes[node].firstChild; child != TRIE_NONE; child = nodes[child].nextSibling) {
+            forEachWord(child, word, fn);
+        }
+        word.resize(length);
     }
 
 public:
     Trie() {
-        root = new TrieNode();
+        newNode(0, 0);
     }
 
-    void insert(const string& word, int value) {
+    void insert(string_view word, int value) {
+        // Uma inserção invalida o ranking; buildRanking deve ser chamado de novo.
+        rankStart.clear();
+        rankIds.clear();
+
         // Normaliza o input em letras minusculas.
         string lowerWord = toLowerCase(word);
-        TrieNode* node = root;
+        uint32_t node = 0;
+        size_t i = 0;
 
         // Percorre a trie e cria nodos caso necessário.
-        for (char ch : lowerWord) {
-            if (node->children[ch] == nullptr) {
-                // se não houver node, cria novo nodo
-                node->children[ch] = new TrieNode();
+        while (i < lowerWord.size()) {
+            unsigned char ch = lowerWord[i];
+            uint32_t previous = TRIE_NONE;
+            uint32_t child = nodes[node].firstChild;
+            while (child != TRIE_NONE && firstByte(child) < ch) {
+                previous = child;
+                child = nodes[child].nextSibling;
+            }
+
+            // Nenhuma aresta começa com 'ch': o restante da palavra vira uma nova folha.
+            if (child == TRIE_NONE || firstByte(child) != ch) {
+                uint32_t leaf = newNode(labels.size(), lowerWord.size() - i);
+                labels.append(lowerWord, i, string::npos);
+                nodes[leaf].nextSibling = child;
+                if (previous == TRIE_NONE) nodes[node].firstChild = leaf;
+                else nodes[previous].nextSibling = leaf;
+                node = leaf;
+                break;
+            }
+
+            // Tamanho do prefixo comum entre o rótulo da aresta e o restante da palavra.
+            uint32_t length = 0;
+            uint32_t limit = min<size_t>(nodes[child].labelLength, lowerWord.size() - i);
+            while (length < limit && labels[nodes[child].labelOffset + length] == lowerWord[i + length]) length++;
+
+            // A palavra diverge no meio da aresta: divide a aresta em duas.
+            if (length < nodes[child].labelLength) {
+                uint32_t middle = newNode(nodes[child].labelOffset, length);
+                nodes[middle].firstChild = child;
+                nodes[middle].nextSibling = nodes[child].nextSibling;
+                nodes[child].nextSibling = TRIE_NONE;
+                nodes[child].labelOffset += length;
+                nodes[child].labelLength -= length;
+                if (previous == TRIE_NONE) nodes[node].firstChild = middle;
+                else nodes[previous].nextSibling = middle;
+                child = middle;
             }
+
             // passa ao próximo nodo
-            node = node->children[ch];
+            node = child;
+            i += length;
         }
 
-        // Ao término da string, marca a flag como true.
-        node->isEndOfWord = true;
+        // Ao término da string, marca o nodo como final.
+        if (nodes[node].valuesIndex == TRIE_NONE) {
+            nodes[node].valuesIndex = values.size();
+            values.emplace_back();
+        }
 
         // Certifica-se de que o valor é único antes de adicioná-lo.
-        if (find(node->values.begin(), node->values.end(), value) == node->values.end()) {
-            node->values.push_back(value);
+        vector<int>& nodeValues = values[nodes[node].valuesIndex];
+        if (find(nodeValues.begin(), nodeValues.end(), value) == nodeValues.end()) {
+            nodeValues.push_back(value);
         }
     }
 
     // Busca de string exata na trie. Recebe a string a ser buscada e um vector que
     // será povoado com os dados satélites nas folhas do nó.
-    bool search(const string& word, vector<int>& values) {
+    bool search(string_view word, vector<int>& result) const {
         // Normaliza o input em minúsculas.
-        std::string lowerWord = toLowerCase(word);
-        TrieNode* node = root;
+        string lowerWord = toLowerCase(word);
+        uint32_t consumed;
+        uint32_t node = descend(lowerWord, consumed);
 
-        // Percorre a trie, caso encontre null pointer, a palavra não está presente.
-        for (char ch : lowerWord) {
-            if (node->children[ch] == nullptr) {
-                return false;
-            }
-            node = node->children[ch]; // Passa ao próximo nó.
-        }
-        if (node->isEndOfWord) {
-            values = node->values; // Retorna os valores caso encontre a palavra.
-            return true;
+        // A palavra precisa terminar exatamente em um nodo final.
+        if (node == TRIE_NONE || consumed != nodes[node].labelLength || nodes[node].valuesIndex == TRIE_NONE) {
+            return false;
         }
-        return false;
+        result = values[nodes[node].valuesIndex]; // Retorna os valores caso encontre a palavra.
+        return true;
     }
 
     // Busca de prefixo. Utiliza chamadas recursivas de 'collectValues' para retornar
     // todos os dados satélites de strings que contém o prefixo desejado.
     // Recebe o prefixo e um vetor que receberá os dados por referência.
-    bool startsWith(const string& prefix, vector<int>& values) {
+    bool startsWith(string_view prefix, vector<int>& result) const {
         string lowerPrefix = toLowerCase(prefix);
-        TrieNode* node = root;
-        for (char ch : lowerPrefix) {
-            if (node->children[ch] == nullptr) {
-                return false;
-            }
-            node = node->children[ch];
+        uint32_t consumed;
+        uint32_t node = descend(lowerPrefix, consumed);
+
+        if (node == TRIE_NONE) return false;
+        collectValues(node, result);
+        return !result.empty();
+    }
+
+    // Reordena os nodos e rótulos em pré-ordem. Depois disso a subárvore de cada nodo
+    // ocupa uma faixa contígua do vetor, e a coleta por prefixo percorre a memória em
+    // sequência. Chamado após a carga em lote.
+    void compact() {
+        vector<TrieNode> outNodes;
+        string outLabels;
+        vector<vector<int>> outValues;
+
+        outNodes.reserve(nodes.size());
+        outLabels.reserve(labels.size());
+        outValues.reserve(values.size());
+        copySubtree(0, outNodes, outLabels, outValues);
+
+        nodes = std::move(outNodes);
+        labels = std::move(outLabels);
+        values = std::move(outValues);
+        rankStart.clear();
+        rankIds.clear();
+    }
+
+    // Calcula, para cada nodo, os 'k' melhores valores da subárvore. 'better(a, b)' deve
+    // retornar true se o valor a vem antes de b (ordem estrita).
+    template <typename Better>
+    void buildRanking(size_t k, Better better) {
+        vector<vector<int>> lists(nodes.size());
+        rankSubtree(0, k, better, lists);
+
+        rankStart.assign(1, 0);
+        rankIds.clear();
+        for (const auto& list : lists) {
+            rankIds.insert(rankIds.end(), list.begin(), list.end());
+            rankStart.push_back(rankIds.size());
+        }
+    }
+
+    // Atualiza o ranking dos nodos no caminho de 'word' depois que o critério de um dos
+    // seus valores mudou (ex.: nova nota de um jogador). Os demais nodos não são afetados.
+    template <typename Better>
+    void refreshRanking(string_view word, Better better) {
+        if (rankStart.empty()) return;
+
+        string lowerWord = toLowerCase(word);
+        vector<uint32_t> path(1, 0);
+        for (size_t i = 0; i < lowerWord.size();) {
+            uint32_t child = nodes[path.back()].firstChild;
+            while (child != TRIE_NONE && firstByte(child) != (unsigned char) lowerWord[i]) child = nodes[child].nextSibling;
+            if (child == TRIE_NONE) return;
+            path.push_back(child);
+            i += nodes[child].labelLength;
+        }
+
+        // Do nodo da palavra até a raiz. O tamanho de cada ranking não muda.
+        vector<int> candidates;
+        for (size_t p = path.size(); p-- > 0;) {
+            uint32_t node = path[p];
+            rankCandidates(node, rankStart[node + 1] - rankStart[node], better, candidates);
+            copy(candidates.begin(), candidates.end(), rankIds.begin() + rankStart[node]);
+        }
+    }
+
+    // Ranking do prefixo: em 'first' e 'count', os melhores valores entre todas as palavras
+    // que começam com 'prefix' (no máximo o 'k' de buildRanking). Retorna false se o
+    // prefixo não existir ou se o ranking não tiver sido calculado.
+    bool ranked(string_view prefix, const int*& first, size_t& count) const {
+        if (rankStart.empty()) return false;
+
+        string lowerPrefix = toLowerCase(prefix);
+        uint32_t consumed;
+        uint32_t node = descend(lowerPrefix, consumed);
+        if (node == TRIE_NONE) return false;
+
+        first = rankIds.data() + rankStart[node];
+        count = rankStart[node + 1] - rankStart[node];
+        return true;
+    }
+
+    // Percorre as palavras em ordem lexicográfica, chamando fn(palavra, valores).
+    template <typename F>
+    void forEachWord(F fn) const {
+        string word;
+        forEachWord(0, word, fn);
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t wordCount() const { return values.size(); }
+
+    // Memória ocupada pelos nodos, rótulos, valores e ranking (capacidade dos vetores).
+    size_t memoryBytes() const {
+        size_t bytes = nodes.capacity() * sizeof(TrieNode) + labels.capacity() + values.capacity() * sizeof(vector<int>)
+                     + rankStart.capacity() * sizeof(uint32_t) + rankIds.capacity() * sizeof(int);
+        for (const auto& nodeValues : values) bytes += nodeValues.capacity() * sizeof(int);
+        return bytes;
+    }
+
+    // Representação plana, usada no snapshot: os valores de todas as palavras ficam
+    // contíguos e valueOffsets[k] indica onde começam os valores de values[k].
+    void flatten(vector<TrieNode>& outNodes, string& outLabels, vector<uint32_t>& valueOffsets, vector<int>& flatValues) const {
+        outNodes = nodes;
+        outLabels = labels;
+        valueOffsets.assign(1, 0);
+        for (const auto& nodeValues : values) {
+            flatValues.insert(flatValues.end(), nodeValues.begin(), nodeValues.end());
+            valueOffsets.push_back(flatValues.size());
+        }
+    }
+
+    void unflatten(const TrieNode* flatNodes, size_t nodeCount, const char* flatLabels, size_t labelBytes,
+                   const uint32_t* valueOffsets, size_t valueLists, const int* flatValues) {
+        nodes.assign(flatNodes, flatNodes + nodeCount);
+        labels.assign(flatLabels, labelBytes);
+        rankStart.clear();
+        rankIds.clear();
+        values.resize(valueLists);
+        for (size_t k = 0; k < valueLists; k++) {
+            values[k].assign(flatValues + valueOffsets[k], flatValues + valueOffsets[k + 1]);
         }
-        collectValues(node, values);
-        return !values.empty();
+        if (nodes.empty()) newNode(0, 0);
     }
 };
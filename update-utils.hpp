@@ -0,0 +1,206 @@
+// update-utils.hpp
+// trshpnd 2024
+//
+// Avaliações ao vivo: comando 'rate <user> <player> <nota>' e modo que acompanha um arquivo
+// (tail -f) com linhas no formato do rating.csv. Uma avaliação substitui a anterior do mesmo
+// usuário para o mesmo jogador, então reaplicar uma linha não muda nada. Cada avaliação
+// aplicada atualiza a soma/contagem do jogador em O(1) e os rankings afetados (caminho do
+// nome na trie e listas das posições do jogador), e é gravada no log de avaliações, que é
+// reaplicado na próxima inicialização.
+
+#pragma once
+
+#include "csv-utils.hpp"
+#include "player-utils.hpp"
+#include "rating-utils.hpp"
+#include "query-utils.hpp"
+#include "load-utils.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+
+using namespace std;
+
+#define RATING_MIN          0.5f
+#define RATING_MAX          5.0f
+#define FOLLOW_POLL_MS      200     // Intervalo entre leituras do arquivo acompanhado.
+
+enum RateResult {
+    RATE_APPLIED,
+    RATE_UNCHANGED,         // Mesma nota que o usuário já tinha dado.
+    RATE_INVALID,           // Nota fora de [0.5, 5] ou que não é múltiplo de 0.5.
+    RATE_UNKNOWN_PLAYER
+};
+
+// Aplica a avaliação. Deve ser chamada com a trava exclusiva (ou antes de haver leitores).
+// 'refresh' = false deixa os rankings de lado, para quando buildRankings ainda vai rodar.
+RateResult applyRating(Database &db, int user_id, int player_id, float value, bool refresh = true){
+    if(!(value >= RATING_MIN && value <= RATING_MAX) || value * 2 != (int) (value * 2)) return RATE_INVALID;
+
+    int index = db.players.find(player_id);
+    if(index < 0) return RATE_UNKNOWN_PLAYER;
+
+    // Usuário novo recebe o próximo índice denso.
+    User* userptr = nullptr;
+    hashSearch(db.users, user_id, userptr);
+    if(!userptr){
+        hashInsert(db.users, User{user_id, (int) db.users.count});
+        hashSearch(db.users, user_id, userptr);
+    }
+
+    float previous;
+    bool rated = db.userRatings.find(userptr->index, player_id, previous);
+    if(rated && previous == value) return RATE_UNCHANGED;
+
+    db.userRatings.update(userptr->index, Rating{player_id, value});
+    db.players.addRating(index, value - (rated ? previous : 0), rated ? 0 : 1);
+    db.updateVersion++;
+
+    if(refresh){
+        RankByRating better{&db.players};
+        db.playerNames.refreshRanking(db.players.text(index, LONG_NAME), better);
+        db.positionIndex.update(db.players, index, better);
+    }
+    return RATE_APPLIED;
+}
+
+// Grava a avaliação no log (mesmo formato do rating.csv, sem cabeçalho). O log é
+// descarregado uma vez por comando ou bloco, em flushRatingLog.
+void logRating(Database &db, int user_id, int player_id, float value){
+    if(!db.ratingLog.is_open()) return;
+    db.ratingLog << user_id << ',' << player_id << ',' << value << '\n';
+}
+
+void flushRatingLog(Database &db){
+    if(db.ratingLog.is_open()) db.ratingLog.flush();
+}
+
+// Aplica as linhas de 'data' (formato do rating.csv). Linhas mal formadas, como o
+// cabeçalho, são ignoradas. Retorna o número de avaliações aplicadas.
+size_t applyRatingRows(Database &db, const char* begin, const char* end, bool refresh, bool log){
+    CsvReader reader(begin, end);
+    int user_id;
+    Rating oRating;
+    size_t applied = 0;
+
+    while(!reader.atEnd()){
+        if(!readRatingRow(reader, user_id, oRating)) continue;
+        if(applyRating(db, user_id, oRating.id, oRating.rating, refresh) != RATE_APPLIED) continue;
+        if(log) logRating(db, user_id, oRating.id, oRating.rating);
+        applied++;
+    }
+    if(log && applied) flushRatingLog(db);
+    return applied;
+}
+
+// Reaplica o log de avaliações (se existir) e o abre para acrescentar as próximas.
+// Chamado depois da carga e antes de buildRankings. Retorna o número de linhas aplicadas.
+size_t openRatingLog(Database &db, const string &path){
+    size_t applied = 0;
+    {
+        MappedFile f(path);
+        if(f.isOpen()) applied = applyRatingRows(db, f.data(), f.data() + f.size(), false, false);
+    }
+    db.ratingLog.open(path, ios::app);
+    return applied;
+}
+
+// Pesq: rate <user_id> <sofifa_id> <nota>
+void queryRate(Database &db, istringstream &iss, ostream &out){
+    string userArg, playerArg, valueArg;
+    int user_id, player_id;
+    float value;
+    iss >> userArg >> playerArg >> valueArg;
+
+    out << endl;
+    if(!parseInt(userArg, user_id) || !parseInt(playerArg, player_id) || !parseFloat(valueArg, value)){
+        out << "Uso: rate <user_id> <sofifa_id> <nota>" << endl;
+        return;
+    }
+
+    RateResult result;
+    {
+        unique_lock<shared_mutex> guard(db.updateLock);
+        result = applyRating(db, user_id, player_id, value);
+        if(result == RATE_APPLIED){
+            logRating(db, user_id, player_id, value);
+            flushRatingLog(db);
+        }
+    }
+
+    switch(result){
+        case RATE_APPLIED:          out << "Avaliacao registrada." << endl; break;
+        case RATE_UNCHANGED:        out << "Avaliacao ja registrada." << endl; break;
+        case RATE_INVALID:          out << "Nota invalida: " << valueArg << endl; break;
+        case RATE_UNKNOWN_PLAYER:   out << "Jogador nao encontrado: " << playerArg << endl; break;
+    }
+}
+
+// true se a linha é um comando que altera a Database.
+bool isUpdateCommand(const string &input){
+    istringstream iss(input);
+    string query_type;
+    iss >> query_type;
+    return toLowerCase(query_type) == "rate";
+}
+
+// Como runQuery, mas aceita também o comando 'rate', que altera a Database. As pesquisas
+// rodam com a trava em modo compartilhado. Durante a carga progressiva, cada pesquisa
+// espera antes a etapa de que precisa.
+QueryType runCommand(Database &db, const string &input, QueryScratch &scratch, ostream &out){
+    waitForStage(db, requiredStage(queryType(input)));
+    if(!isUpdateCommand(input)){
+        shared_lock<shared_mutex> guard(db.updateLock);
+        return runQuery(db, input, scratch, out);
+    }
+
+    istringstream iss(input);
+    string query_type;
+    iss >> query_type;
+
+    auto start = chrono::steady_clock::now();
+    queryRate(db, iss, out);
+    out << endl;
+    db.queryCounters[QUERY_RATE].record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    return QUERY_RATE;
+}
+
+// Acompanha 'path' como tail -f até 'stop', aplicando as linhas novas. O arquivo é lido
+// desde o início: as linhas já aplicadas antes não mudam nada. As linhas completas de cada
+// bloco lido são aplicadas sob uma única tomada da trava.
+void followRatings(Database &db, const string &path, const atomic<bool> &stop){
+    waitForStage(db, LOAD_COMPLETE);
+    ifstream in;
+    string pending;
+    vector<char> buffer(1 << 16);
+
+    while(!stop){
+        if(!in.is_open()) in.open(path, ios::binary);
+
+        bool read = false;
+        while(in.is_open() && !stop && (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)){
+            read = true;
+            pending.append(buffer.data(), in.gcount());
+
+            // Só linhas completas; o resto espera o próximo bloco.
+            size_t complete = pending.rfind('\n');
+            if(complete == string::npos) continue;
+            {
+                unique_lock<shared_mutex> guard(db.updateLock);
+                applyRatingRows(db, pending.data(), pending.data() + complete + 1, true, true);
+            }
+            pending.erase(0, complete + 1);
+        }
+        in.clear();     // Limpa o EOF para a próxima leitura.
+
+        if(!read) this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+    }
+}